@@ -0,0 +1,242 @@
+#ifndef AMF_LB_H
+#define AMF_LB_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "sim_util.h"
+
+/*
+ * Chọn AMF cho UE mới ở gNB. Các AMF còn nhận được UE (đã kết nối,
+ * count < capacity, weight > 0) nằm trong một binary heap có chỉ mục nên
+ * pick/release/join/leave đều O(log N):
+ *   swrr  : smooth WRR dạng stride scheduling, key = pass, pass += LB_STRIDE / weight
+ *   least : key = count / capacity (ít tải nhất theo tỉ lệ)
+ *   p2c   : power-of-two-choices, lấy ngẫu nhiên 2 phần tử trong heap, O(1)
+ *   chash : consistent hash theo TMSI trên vòng vnode (tìm nhị phân),
+ *           AMF đầy/down thì đi tiếp theo chiều kim đồng hồ
+ * Load report từ AMF (lb_report) cập nhật capacity, load thực tế và weight:
+ * weight = phần capacity còn trống, giảm theo latency xử lý của AMF.
+ * Không thread-safe: gNB gọi dưới amf_lock.
+ */
+#define LB_STRIDE (1ULL << 32)
+#define LB_VNODES 64            // vnode mỗi AMF trên vòng consistent hash
+#define LB_LAT_REF_US 1000      // latency ứng với weight giảm một nửa
+
+typedef enum { LB_SWRR, LB_LEAST, LB_P2C, LB_CHASH } LbStrategy;
+
+typedef struct {
+    uint64_t hash;
+    int amf;
+} LbVnode;
+
+typedef struct {
+    LbStrategy strategy;
+    int n;
+    int *count;         // số UE đã gán cho AMF
+    int *load;          // load AMF báo về gần nhất
+    int *capacity;
+    int *weight;
+    int *up;            // AMF đang kết nối
+    uint64_t *pass;     // swrr
+    uint64_t vtime;     // pass của lần pick gần nhất (swrr)
+    int *heap;          // AMF đủ điều kiện
+    int *pos;           // vị trí trong heap, -1 nếu không có
+    int size;
+    LbVnode *ring;      // chash, n * LB_VNODES vnode đã sắp xếp
+    unsigned int seed;  // p2c
+} AmfLb;
+
+static inline int lb_parse(const char *name, LbStrategy *out) {
+    static const char *names[] = { "swrr", "least", "p2c", "chash" };
+    for (int i = 0; i < 4; i++)
+        if (strcmp(name, names[i]) == 0) { *out = (LbStrategy)i; return 0; }
+    return -1;
+}
+
+// tải dùng để chọn: lấy số lớn hơn giữa số UE gNB đã gán và load AMF báo
+static inline int lb_used(const AmfLb *lb, int i) {
+    return lb->count[i] > lb->load[i] ? lb->count[i] : lb->load[i];
+}
+
+// a nên được chọn trước b
+static inline int lb_before(const AmfLb *lb, int a, int b) {
+    if (lb->strategy == LB_SWRR) {
+        if (lb->pass[a] != lb->pass[b]) return lb->pass[a] < lb->pass[b];
+    } else {
+        int64_t l = (int64_t)lb_used(lb, a) * lb->capacity[b];
+        int64_t r = (int64_t)lb_used(lb, b) * lb->capacity[a];
+        if (l != r) return l < r;
+    }
+    return a < b;
+}
+
+static inline void lb_heap_set(AmfLb *lb, int k, int amf) {
+    lb->heap[k] = amf;
+    lb->pos[amf] = k;
+}
+
+static inline void lb_sift_up(AmfLb *lb, int k) {
+    int amf = lb->heap[k];
+    while (k > 0) {
+        int p = (k - 1) / 2;
+        if (!lb_before(lb, amf, lb->heap[p])) break;
+        lb_heap_set(lb, k, lb->heap[p]);
+        k = p;
+    }
+    lb_heap_set(lb, k, amf);
+}
+
+static inline void lb_sift_down(AmfLb *lb, int k) {
+    int amf = lb->heap[k];
+    while (1) {
+        int c = 2 * k + 1;
+        if (c >= lb->size) break;
+        if (c + 1 < lb->size && lb_before(lb, lb->heap[c + 1], lb->heap[c])) c++;
+        if (!lb_before(lb, lb->heap[c], amf)) break;
+        lb_heap_set(lb, k, lb->heap[c]);
+        k = c;
+    }
+    lb_heap_set(lb, k, amf);
+}
+
+// đưa AMF vào/ra heap hoặc sửa vị trí sau khi count/capacity/weight đổi
+static inline void lb_update(AmfLb *lb, int i) {
+    int ok = lb->up[i] && lb->weight[i] > 0 && lb_used(lb, i) < lb->capacity[i];
+    int k = lb->pos[i];
+    if (ok && k < 0) {
+        // swrr: AMF quay lại không được dồn lượt đã bỏ lỡ
+        if (lb->pass[i] < lb->vtime) lb->pass[i] = lb->vtime;
+        k = lb->size++;
+        lb_heap_set(lb, k, i);
+        lb_sift_up(lb, k);
+    } else if (!ok && k >= 0) {
+        lb->pos[i] = -1;
+        int last = lb->heap[--lb->size];
+        if (k < lb->size) {
+            lb_heap_set(lb, k, last);
+            lb_sift_up(lb, k);
+            lb_sift_down(lb, lb->pos[last]);
+        }
+    } else if (ok) {
+        lb_sift_up(lb, k);
+        lb_sift_down(lb, lb->pos[i]);
+    }
+}
+
+static inline int lb_vnode_cmp(const void *a, const void *b) {
+    uint64_t x = ((const LbVnode *)a)->hash, y = ((const LbVnode *)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+static inline void lb_init(AmfLb *lb, int n, LbStrategy strategy, unsigned int seed) {
+    memset(lb, 0, sizeof(*lb));
+    lb->strategy = strategy;
+    lb->n = n;
+    lb->seed = seed;
+    lb->count = calloc(n, sizeof(int));
+    lb->load = calloc(n, sizeof(int));
+    lb->capacity = calloc(n, sizeof(int));
+    lb->weight = calloc(n, sizeof(int));
+    lb->up = calloc(n, sizeof(int));
+    lb->pass = calloc(n, sizeof(uint64_t));
+    lb->heap = calloc(n, sizeof(int));
+    lb->pos = malloc(n * sizeof(int));
+    if (!lb->count || !lb->load || !lb->capacity || !lb->weight || !lb->up || !lb->pass || !lb->heap || !lb->pos) {
+        perror("lb_init"); exit(1);
+    }
+    for (int i = 0; i < n; i++) lb->pos[i] = -1;
+    if (strategy == LB_CHASH) {
+        // vòng cố định cho mọi AMF id, AMF join/leave không làm xáo trộn UE của AMF khác
+        lb->ring = malloc((size_t)n * LB_VNODES * sizeof(LbVnode));
+        if (!lb->ring) { perror("lb_init"); exit(1); }
+        for (int i = 0; i < n; i++)
+            for (int v = 0; v < LB_VNODES; v++) {
+                lb->ring[i * LB_VNODES + v].hash = sim_hash64(((uint64_t)i << 32) | v);
+                lb->ring[i * LB_VNODES + v].amf = i;
+            }
+        qsort(lb->ring, (size_t)n * LB_VNODES, sizeof(LbVnode), lb_vnode_cmp);
+    }
+}
+
+// AMF join (hoặc join lại): count giữ nguyên vì UE cũ có thể vẫn đang gán
+static inline void lb_join(AmfLb *lb, int i, int capacity, int weight) {
+    lb->up[i] = 1;
+    lb->capacity[i] = capacity;
+    lb->weight[i] = weight;
+    lb_update(lb, i);
+}
+
+static inline void lb_leave(AmfLb *lb, int i) {
+    lb->up[i] = 0;
+    lb_update(lb, i);
+}
+
+// load report từ AMF i
+static inline void lb_report(AmfLb *lb, int i, int load, int capacity, uint32_t latency_us) {
+    int free_slots = capacity - load;
+    lb->load[i] = load;
+    lb->capacity[i] = capacity;
+    lb->weight[i] = free_slots <= 0 ? 0 :
+        (int)((int64_t)free_slots * LB_LAT_REF_US / (LB_LAT_REF_US + latency_us)) + 1;
+    lb_update(lb, i);
+}
+
+// AMF i từ chối vì quá tải: coi như đầy cho tới load report kế tiếp
+static inline void lb_saturate(AmfLb *lb, int i) {
+    if (lb->load[i] < lb->capacity[i]) lb->load[i] = lb->capacity[i];
+    lb_update(lb, i);
+}
+
+// UE rời AMF i (AMF down, gửi lỗi, ...)
+static inline void lb_release(AmfLb *lb, int i) {
+    lb->count[i]--;
+    lb_update(lb, i);
+}
+
+static inline int lb_chash_pick(const AmfLb *lb, uint64_t key) {
+    int total = lb->n * LB_VNODES;
+    uint64_t h = sim_hash64(key);
+    int lo = 0, hi = total;   // vnode đầu tiên có hash >= h
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (lb->ring[mid].hash < h) lo = mid + 1;
+        else hi = mid;
+    }
+    for (int k = 0; k < total; k++) {
+        int amf = lb->ring[(lo + k) % total].amf;
+        if (lb->pos[amf] >= 0) return amf;
+    }
+    return -1;
+}
+
+// chọn AMF cho UE có key (TMSI) và tăng count; -1 nếu không AMF nào nhận được
+static inline int lb_pick(AmfLb *lb, uint64_t key) {
+    if (lb->size == 0) return -1;
+    int amf;
+    switch (lb->strategy) {
+    case LB_SWRR:
+        amf = lb->heap[0];
+        lb->vtime = lb->pass[amf];
+        lb->pass[amf] += LB_STRIDE / lb->weight[amf];
+        break;
+    case LB_P2C: {
+        int a = lb->heap[rand_r(&lb->seed) % lb->size];
+        int b = lb->heap[rand_r(&lb->seed) % lb->size];
+        amf = lb_before(lb, a, b) ? a : b;
+        break;
+    }
+    case LB_CHASH:
+        amf = lb_chash_pick(lb, key);
+        break;
+    default:
+        amf = lb->heap[0];
+        break;
+    }
+    lb->count[amf]++;
+    lb_update(lb, amf);
+    return amf;
+}
+
+#endif
@@ -8,48 +8,96 @@
 #include <time.h>
 #include <netinet/sctp.h>
 #include <sys/time.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include "sim_msg.h"
+#include "doorbell.h"
+#include "timer_wheel.h"
+#include "ngap_batch.h"
+#include "shm_ring.h"
+#include "sctp_stream.h"
+#include "ue_table.h"
+#include "load_report.h"
+#include "latency_hist.h"
+#include "log.h"
 
-#define NUM_AMF 5
-#define NUM_UE 200
-#define GNB_PORT 9100
+#define DEFAULT_NUM_AMF 5
+#define DEFAULT_NUM_UE 200
+#define GNB_PORT 9100            // port gNB mặc định, -g cho nhiều gNB
 #define GNB_IP "127.0.0.1"
+#define AMF_FEATURES (FEAT_BATCH | FEAT_LOAD_REPORT | FEAT_PAGING_LIST) // feature AMF đề nghị với gNB
+#define GNB_REDIAL_MS 5000       // gNB chưa listen / vừa đóng: thử nối lại trong khoảng này (-r)
+#define CONNECT_RETRY_MS 100
+#define AMF_WORKERS 4            // số worker mặc định mỗi AMF, UE chia theo amf_worker_of
+#define MAX_GNB 64
+#define PAGING_LIST_MS 2         // paging list của association gom paging của mọi worker trong cửa sổ này
 
-#define MSG_RRC_NGAP_REQ 0x12
-#define MSG_NGAP_RESP    0x13
-#define MSG_NGAP_RRC_PAGING 0x14
-#define MSG_INIT         0x09  
+struct AMF;
 
-#define BM_RANDOM_VALUE  0x01
-#define BM_5G_STMSI      0x02
-
-typedef struct {
-    uint8_t msgid;
-    uint8_t bitmask;
-    uint16_t ue_id;
-    uint64_t tmsi;
-    uint64_t s_tmsi;
-} Message;
-
-// khởi tạo init message để gán capacity cho gnb
+/*
+ * Association từ một AMF tới một gNB. Mỗi AMF nối tới mọi gNB trong -g và
+ * có một thread nhận cho mỗi association; worker và context UE thì dùng chung.
+ */
 typedef struct {
-    uint8_t msgid;  
-    int amf_id;
-    int capacity;
-} InitMessage;
+    struct AMF *amf;
+    int idx;                           // chỉ số gNB (thứ tự trong -g)
+    _Atomic int sock_fd;               // -1: chưa nối hoặc đã đóng; link thread ghi, worker đọc
+    int *socks;                        // mọi fd link đã mở, đóng trong main sau khi worker dừng
+    int n_socks;
+    _Atomic uint32_t features;         // feature gNB đã chấp nhận
+    _Atomic int n_streams;             // số stream đã thỏa thuận với gNB
+    pthread_t tid;
+    pthread_mutex_t page_lock;         // bảo vệ pages / page_tick, mọi worker cùng thêm
+    PagingList pages;                  // paging của mọi worker đến hạn trong tick page_tick
+    unsigned long long page_tick;      // ms của paging đầu tiên trong pages
+    _Atomic int page_pending;          // pages còn bản ghi chưa gửi
+} GnbLink;
 
+/*
+ * Worker sở hữu lát UE có amf_worker_of(...) == idx: chỉ worker này đọc/ghi
+ * context, timer paging và batch gửi của các UE đó nên hot path không cần khóa.
+ */
 typedef struct {
+    MsgRing *q;                    // request: mỗi GnbLink một ring SPSC -> worker
+    Doorbell bell;
+    struct AMF *amf;
+    int idx;
+    unsigned int seed;             // rand_r riêng cho worker
+    TimerWheel paging_wheel;       // timer paging (attach_time + y) của lát UE
+    UeTable ues;                   // context UE của lát, tra theo ue_id / S-TMSI
+    MsgBatch *out;                 // response (+ paging khi gNB không có paging list) theo (gNB, stream)
+    PagingList *pages;             // paging worker gom trong tick hiện tại, mỗi gNB một list
+    PagingList page_out;           // list của GnbLink lấy ra để gửi ngoài page_lock
+    unsigned long long tick;       // ms của lượt tw_advance hiện tại
+    _Atomic uint32_t lat_us;       // EWMA thời gian xử lý một burst request
+    uint32_t trace_seq;            // trace id cho paging do worker tạo
+    pthread_t tid;
+} AmfWorker;
+
+typedef struct AMF {
     int amf_id;
     int capacity;
-    int current_load;
-    int sock_fd;
-    uint16_t registered_ues[NUM_UE];  // Lưu số lương UE registered
-    uint64_t ue_s_tmsi[NUM_UE];       // lưu s-tmsi của UE
-    unsigned long long ue_attach_time[NUM_UE]; // Lưu thời gian attach
-    int ue_paging_delay[NUM_UE]; // Lưu y random cho mỗi UE
+    _Atomic int current_load;
+    int n_gnb;
+    GnbLink *links;                    // n_gnb association
+    _Atomic int n_up;                  // association chưa đóng; 0 thì worker dừng
+    _Atomic int report_busy;           // một worker gửi load report tại một thời điểm
+    _Atomic int reported_load;         // load trong report gần nhất
+    _Atomic unsigned long long next_report;  // hạn gửi report định kỳ (ms)
+    int n_workers;
+    AmfWorker *workers;                // n_workers phần tử, căn theo cache line
 } AMF;
 
-AMF amfs[NUM_AMF];
-pthread_mutex_t send_mutex = PTHREAD_MUTEX_INITIALIZER;
+AMF *amfs;
+int num_amf = DEFAULT_NUM_AMF;
+int num_ue = DEFAULT_NUM_UE;           // chỉ để in % load
+int n_workers = AMF_WORKERS;
+unsigned int base_seed;                // -s, mặc định theo thời gian
+const char *ctx_dir;                   // -d: lưu context UE vào file để khởi động lại nhanh
+int gnb_ports[MAX_GNB] = { GNB_PORT };
+int n_gnb = 1;
+int redial_ms = GNB_REDIAL_MS;         // -r, 0: nối lại gNB mãi
 
 // Hàm lấy thời gian thực
 unsigned long long current_millis() {
@@ -58,8 +106,8 @@ unsigned long long current_millis() {
     return tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
 }
 
-static inline int rand_step500() {
-    return 500 * (rand() % 6 + 1); // 500..3000 ms
+static inline int rand_step500(unsigned int *seed) {
+    return 500 * (rand_r(seed) % 6 + 1); // 500..3000 ms
 }
 
 // Hàm in time thực
@@ -73,157 +121,590 @@ void print_current_time() {
     printf("[Time] %s:%06ld\n", buff, tv.tv_usec);
 }
 
-// Thread gửi paging theo y (ms) delay
-void *paging_thread(void *arg) {
-    srand(time(NULL));
+static int amf_sctp_send(int fd, const void *buf, size_t len, uint16_t stream) {
+    return sctp_sendmsg(fd, buf, len, NULL, 0, 0, 0, stream, 0, 0);
+}
+
+// worker sở hữu UE: theo 24 bit thấp của TMSI (gNB gửi kèm TMSI trong mọi request)
+// để request của cùng một UE qua gNB nào cũng về cùng worker / cùng context
+static inline int amf_worker_of(const Message *m, int n) {
+    return (uint32_t)(m->tmsi & 0xFFFFFF) % n;
+}
+
+// gom bản tin gửi gNB g vào batch theo stream của UE, gửi ngay khi batch đầy
+static void queue_out(AmfWorker *w, int g, const Message *m) {
+    GnbLink *l = &w->amf->links[g];
+    int fd = atomic_load(&l->sock_fd);
+    if (fd < 0) return;   // gNB đã rời
+    int st = ue_stream(m->ue_id, atomic_load(&l->n_streams));
+    MsgBatch *b = &w->out[g * SCTP_STREAMS + st];
+    if (batch_add(b, m))
+        batch_flush(b, fd, atomic_load(&l->features), st, amf_sctp_send);
+}
+
+/*
+ * Paging list của một association dùng chung cho mọi worker: worker gom paging
+ * đến hạn trong lượt tw_advance vào list riêng (không khóa), cuối lượt gộp vào
+ * list của GnbLink (một lần khóa mỗi gNB mỗi lượt). Wheel của các worker thức
+ * lệch nhau vài trăm µs nên list của GnbLink giữ PAGING_LIST_MS kể từ paging
+ * đầu tiên rồi mới gửi (sớm hơn nếu đầy PAGING_MAX): paging đến hạn cùng tick
+ * ở mọi worker đi chung một datagram, paging chậm thêm tối đa PAGING_LIST_MS.
+ * Gửi trên stream 0: paging của một UE đến sau response attach ít nhất 500 ms
+ * nên không cần đi cùng stream của UE.
+ */
+// lấy list của l ra page_out của worker; gọi khi giữ page_lock
+static void take_pages(AmfWorker *w, GnbLink *l) {
+    w->page_out.count = l->pages.count;
+    memcpy(w->page_out.frame.recs, l->pages.frame.recs, l->pages.count * sizeof(PagingRecord));
+    l->pages.count = 0;
+    atomic_store(&l->page_pending, 0);
+}
+
+static void send_pages(AmfWorker *w, GnbLink *l) {
+    int fd = atomic_load(&l->sock_fd);
+    if (fd < 0) {   // gNB đã rời
+        w->page_out.count = 0;
+        return;
+    }
+    int n = paging_flush(&w->page_out, fd, 0, amf_sctp_send);
+    if (n < 0) perror("send paging to gNB");
+    else if (n > 0) LOG_INF("AMF%d: Sent %d pagings to gNB%d in one message", w->amf->amf_id+1, n, l->idx + 1);
+}
+
+// gộp paging worker vừa gom cho gNB g vào list của association
+static void merge_pages(AmfWorker *w, int g) {
+    GnbLink *l = &w->amf->links[g];
+    PagingList *mine = &w->pages[g];
+    int k = 0;
+    while (k < mine->count) {
+        int send = 1;
+        pthread_mutex_lock(&l->page_lock);
+        if (l->pages.count && w->tick >= l->page_tick + PAGING_LIST_MS) {
+            take_pages(w, l);   // list đã hết cửa sổ đi riêng, trước paging mới
+        } else {
+            if (l->pages.count == 0) l->page_tick = w->tick;
+            int n = mine->count - k;
+            if (n > PAGING_MAX - l->pages.count) n = PAGING_MAX - l->pages.count;
+            memcpy(&l->pages.frame.recs[l->pages.count], &mine->frame.recs[k], n * sizeof(PagingRecord));
+            l->pages.count += n;
+            k += n;
+            if (l->pages.count == PAGING_MAX) take_pages(w, l);
+            else {
+                atomic_store(&l->page_pending, 1);
+                send = 0;
+            }
+        }
+        pthread_mutex_unlock(&l->page_lock);
+        if (send) send_pages(w, l);
+    }
+    mine->count = 0;
+}
+
+// gửi list của các association đã hết cửa sổ; trả về 1 nếu còn list đang gom
+static int flush_due_pages(AmfWorker *w) {
+    AMF *a = w->amf;
+    int pending = 0;
+    for (int g = 0; g < a->n_gnb; g++) {
+        GnbLink *l = &a->links[g];
+        if (!atomic_load(&l->page_pending)) continue;
+        pthread_mutex_lock(&l->page_lock);
+        int due = l->pages.count && w->tick >= l->page_tick + PAGING_LIST_MS;
+        if (due) take_pages(w, l);
+        else pending |= l->pages.count > 0;
+        pthread_mutex_unlock(&l->page_lock);
+        if (due) send_pages(w, l);
+    }
+    return pending;
+}
+
+static void queue_paging(AmfWorker *w, int g, const Message *m) {
+    if (atomic_load(&w->amf->links[g].sock_fd) < 0) return;
+    if (paging_add(&w->pages[g], m)) merge_pages(w, g);
+}
+
+static void flush_out(AmfWorker *w) {
+    AMF *a = w->amf;
+    for (int g = 0; g < a->n_gnb; g++) {
+        GnbLink *l = &a->links[g];
+        int fd = atomic_load(&l->sock_fd);
+        if (fd < 0) {   // gNB vừa rời: bỏ phần còn trong batch
+            for (int st = 0; st < SCTP_STREAMS; st++) w->out[g * SCTP_STREAMS + st].count = 0;
+            w->pages[g].count = 0;
+            continue;
+        }
+        merge_pages(w, g);
+        int n_streams = atomic_load(&l->n_streams);
+        uint32_t features = atomic_load(&l->features);
+        for (int st = 0; st < n_streams; st++)
+            if (batch_flush(&w->out[g * SCTP_STREAMS + st], fd, features, st,
+                            amf_sctp_send) < 0)
+                perror("send to gNB");
+    }
+}
+
+// trả lời request: mang trace của request, đo thời gian xử lý tại AMF
+static void reply(AmfWorker *w, int g, Message *resp, const Message *req) {
+    resp->trace = req->trace;
+    trace_stamp(&resp->trace, HOP_AMF_TX);
+    lat_record_hops(LAT_AMF_PROC, &resp->trace, HOP_AMF_RX, HOP_AMF_TX);
+    queue_out(w, g, resp);
+}
+
+// timer paging hết hạn (attach_time + y)
+static void fire_paging(TimerNode *t, void *arg) {
+    AmfWorker *w = (AmfWorker *)arg;
+    AMF *a = w->amf;
+    UeContext *ue = ue_of_timer(t);
+    if (!ue->registered || !ue->s_tmsi) return;
+
+    Message paging = {0};
+    paging.msgid = MSG_NGAP_RRC_PAGING; // 0x14
+    paging.version = WIRE_VERSION;
+    paging.bitmask = BM_5G_STMSI;
+    paging.ue_id = ue->ue_id;
+    paging.s_tmsi = ue->s_tmsi;
+    // paging là gốc trace paging -> connect
+    trace_start(&paging.trace, ((uint32_t)(a->amf_id + 1) << 24) | ((uint32_t)w->idx << 20) |
+                               (++w->trace_seq & 0xFFFFF));
+    trace_stamp(&paging.trace, HOP_AMF_TX);
+    // paging qua gNB đang phục vụ UE; các paging cùng tick gom vào một paging list
+    if (atomic_load(&a->links[ue->gnb].features) & FEAT_PAGING_LIST) queue_paging(w, ue->gnb, &paging);
+    else queue_out(w, ue->gnb, &paging);
+    LOG_DBG("AMF%d: Sent Paging for UE%u via gNB%d (S-TMSI=0x%llx, y=%dms)",
+           a->amf_id+1, ue->ue_id, ue->gnb + 1, (unsigned long long)ue->s_tmsi, ue->paging_delay);
+    // Reset attach_time, timer đã được gỡ khỏi wheel
+    ue->attach_time = 0;
+}
+
+// giữ một chỗ trong capacity cho UE mới; trả về 0 nếu AMF đã đầy
+static int reserve_load(AMF *a) {
+    int cur = atomic_load(&a->current_load);
+    while (cur < a->capacity)
+        if (atomic_compare_exchange_weak(&a->current_load, &cur, cur + 1)) return 1;
+    return 0;
+}
+
+// UE vừa liên lạc qua gNB g: bind context sang đó để response / paging sau đi đúng gNB
+static void bind_ue(AmfWorker *w, UeContext *ue, int g, uint32_t ue_id) {
+    int from = ue->gnb;
+    if (ue_table_bind(&w->ues, ue, g, ue_id))
+        LOG_INF("AMF%d: UE S-TMSI=0x%llx moved gNB%d -> gNB%d",
+               w->amf->amf_id+1, (unsigned long long)ue->s_tmsi, from + 1, g + 1);
+}
+
+// xử lý một NGAP request từ gNB g; UE thuộc lát của worker w
+static void handle_ngap_req(AmfWorker *w, int g, const Message *req) {
+    AMF *a = w->amf;
+    if (req->msgid != MSG_RRC_NGAP_REQ) return;
+
+    // S-TMSI tính từ TMSI nên là khóa toàn cục của UE, dù attach qua gNB nào
+    uint64_t s = ((uint64_t)(a->amf_id & 0x3FF) << 30) |
+                 ((uint64_t)(a->amf_id & 0x3F) << 24) |
+                 (req->tmsi & 0xFFFFFF);
+    UeContext *ue = req->bitmask & BM_RANDOM_VALUE ? ue_table_find_stmsi(&w->ues, s) : NULL;
+    if (req->bitmask & BM_RANDOM_VALUE &&
+        ((ue && ue->registered) || reserve_load(a))) {
+        Message resp = {0};
+        resp.msgid = MSG_NGAP_RESP;
+        resp.version = WIRE_VERSION;
+        resp.bitmask = BM_RANDOM_VALUE;
+        resp.ue_id = req->ue_id;
+        resp.tmsi = req->tmsi;
+        resp.s_tmsi = s;
+
+        if (!ue) ue = ue_table_get(&w->ues, g, req->ue_id);
+        else bind_ue(w, ue, g, req->ue_id);
+        ue_table_set_stmsi(&w->ues, ue, s);
+        ue->attach_time = current_millis(); // Lưu thời gian attach
+        ue->paging_delay = rand_step500(&w->seed); // Random y
+        tw_add(&w->paging_wheel, &ue->paging_timer, ue->attach_time + ue->paging_delay);
+        reply(w, g, &resp, req);
+
+        if (!ue->registered) {
+            ue->registered = 1;   // load đã tăng trong reserve_load
+            LOG_INF("AMF%d: current load = %d (%.2f%%)",
+                   a->amf_id+1, a->current_load,
+                   (float)a->current_load/num_ue*100.0f);
+        }
+    } else if (req->bitmask & BM_RANDOM_VALUE) {
+        // AMF đầy: trả reject (echo request) để gNB chuyển UE sang AMF khác
+        Message rej = *req;
+        rej.msgid = MSG_NGAP_REJECT;
+        rej.cause = CAUSE_OVERLOAD;
+        reply(w, g, &rej, req);
+        LOG_WRN("AMF%d: Rejected UE%u (overload, load=%d/%d)",
+               a->amf_id+1, req->ue_id, a->current_load, a->capacity);
+    } else if (req->bitmask & BM_5G_STMSI) {
+        // service request: UE tự nhận diện bằng S-TMSI
+        ue = ue_table_find_stmsi(&w->ues, req->s_tmsi);
+        if (!ue) {
+            // context không có ở AMF này (UE được chuyển từ AMF đã chết): UE phải đăng ký lại
+            Message rej = *req;
+            rej.msgid = MSG_NGAP_REJECT;
+            rej.cause = CAUSE_UE_UNKNOWN;
+            reply(w, g, &rej, req);
+            LOG_WRN("AMF%d: Unknown S-TMSI 0x%llx from UE%u, asking it to re-register",
+                   a->amf_id+1, (unsigned long long)req->s_tmsi, req->ue_id);
+            return;
+        }
+        bind_ue(w, ue, g, req->ue_id);
+        Message resp = {0};
+        resp.msgid = MSG_NGAP_RESP;
+        resp.version = WIRE_VERSION;
+        resp.bitmask = BM_5G_STMSI;
+        resp.ue_id = req->ue_id;
+        resp.s_tmsi = ue->s_tmsi;
+        reply(w, g, &resp, req);
+        LOG_INF("AMF%d: Service response for UE%d (S-TMSI=0x%llx, load unchanged)", a->amf_id+1, req->ue_id, (unsigned long long)resp.s_tmsi);
+    }
+}
+
+// có gNB nào đang nhận load report không
+static int amf_reports(const AMF *a) {
+    for (int g = 0; g < a->n_gnb; g++)
+        if (atomic_load(&a->links[g].sock_fd) >= 0 && (atomic_load(&a->links[g].features) & FEAT_LOAD_REPORT))
+            return 1;
+    return 0;
+}
+
+// gửi MSG_LOAD_REPORT khi đến kỳ, khi load đổi >= 1/LOAD_REPORT_STEP capacity hoặc khi vừa đầy.
+// Report mang load của cả AMF và gửi tới mọi gNB, nên gNB nào cũng thấy UE do gNB khác gán
+static void maybe_report_load(AMF *a, unsigned long long now) {
+    if (!amf_reports(a)) return;
+    int load = atomic_load(&a->current_load);
+    int last = atomic_load(&a->reported_load);
+    int step = a->capacity / LOAD_REPORT_STEP > 0 ? a->capacity / LOAD_REPORT_STEP : 1;
+    int diff = load > last ? load - last : last - load;
+    if (now < atomic_load(&a->next_report) && diff < step &&
+        !(load >= a->capacity && last < a->capacity)) return;
+    if (atomic_exchange(&a->report_busy, 1)) return;   // worker khác đang gửi
+
+    LoadReport r = { .msgid = MSG_LOAD_REPORT, .version = WIRE_VERSION, .load = load, .capacity = a->capacity };
+    for (int k = 0; k < a->n_workers; k++) {
+        uint32_t lat = atomic_load(&a->workers[k].lat_us);
+        if (lat > r.latency_us) r.latency_us = lat;
+    }
+    wire_ctl_order(&r, sizeof(r));
+    for (int g = 0; g < a->n_gnb; g++) {
+        GnbLink *l = &a->links[g];
+        int fd = atomic_load(&l->sock_fd);
+        if (fd < 0 || !(atomic_load(&l->features) & FEAT_LOAD_REPORT)) continue;
+        if (amf_sctp_send(fd, &r, sizeof(r), 0) < 0) perror("send load report");
+    }
+    atomic_store(&a->reported_load, load);
+    atomic_store(&a->next_report, now + LOAD_REPORT_MS);
+    atomic_store(&a->report_busy, 0);
+}
+
+// Thread worker: xử lý request và paging của lát UE, ngủ tới request mới hoặc paging gần nhất
+void *amf_worker(void *arg) {
+    AmfWorker *w = (AmfWorker *)arg;
+    AMF *a = w->amf;
+    Message reqs[RING_BURST];
     while (1) {
+        uint32_t seen = doorbell_seq(&w->bell);
+        uint32_t n = 0;
+        long long t0 = 0;
+        for (int g = 0; g < a->n_gnb; g++) {
+            uint32_t got = ring_dequeue_burst(&w->q[g], reqs, RING_BURST);
+            if (got && !t0) t0 = sim_now_us();
+            for (uint32_t k = 0; k < got; k++) handle_ngap_req(w, g, &reqs[k]);
+            n += got;
+        }
+
+        // paging đến hạn của tick này vào paging list của association (hoặc batch response)
         unsigned long long now = current_millis();
-        for (int i = 0; i < NUM_AMF; i++) {
-            AMF *a = &amfs[i];
-            for (int j = 0; j < NUM_UE; j++) {
-                if (a->registered_ues[j] && a->ue_s_tmsi[j] && a->ue_attach_time[j] > 0) {
-					
-                    // Kiểm tra nếu đã đến thời điểm gửi paging (attach_time + y)
-                    if (now >= a->ue_attach_time[j] + a->ue_paging_delay[j]) {
-                        Message paging = {0};
-                        paging.msgid = MSG_NGAP_RRC_PAGING; // 0x14
-                        paging.bitmask = BM_5G_STMSI;
-                        paging.ue_id = j;
-                        paging.s_tmsi = a->ue_s_tmsi[j];
-
-                        pthread_mutex_lock(&send_mutex);
-                        if (a->sock_fd > 0) {
-                            int r = sctp_sendmsg(a->sock_fd, &paging, sizeof(paging),
-                                                 NULL, 0, 0, 0, 0, 0, 0);
-                            if (r > 0) {
-                                printf("AMF%d: Sent Paging for UE%d (S-TMSI=0x%llx, y=%dms)\n",
-                                       i+1, j, (unsigned long long)a->ue_s_tmsi[j], a->ue_paging_delay[j]);
-                            }
-                            // Reset attach_time để tránh gửi lại paging
-                            a->ue_attach_time[j] = 0;
-                        }
-                        pthread_mutex_unlock(&send_mutex);
-                    }
-                }
+        w->tick = now;
+        tw_advance(&w->paging_wheel, now, fire_paging, w);
+        flush_out(w);
+        int pages_left = flush_due_pages(w);
+        if (n) {
+            int64_t lat = atomic_load(&w->lat_us);
+            lat += (sim_now_us() - t0 - lat) / 8;
+            atomic_store(&w->lat_us, (uint32_t)lat);
+        }
+        maybe_report_load(a, now);
+
+        if (n == 0) {
+            if (atomic_load(&a->n_up) == 0) break;   // mọi association đã đóng
+            long timeout = tw_next_timeout(&w->paging_wheel, now);
+            if (pages_left && (timeout < 0 || timeout > 1)) timeout = 1;   // gửi list khi hết cửa sổ
+            // worker 0 thức dậy để gửi report định kỳ
+            if (w->idx == 0 && amf_reports(a)) {
+                unsigned long long due = atomic_load(&a->next_report);
+                long until = due > now ? (long)(due - now) : 0;
+                if (timeout < 0 || until < timeout) timeout = until;
             }
+            doorbell_wait(&w->bell, seen, timeout);
         }
-        usleep(1000); // Ngủ ngắn để giảm tải CPU
     }
     return NULL;
 }
 
-// Thread xử lý kết nối của mỗi AMF
-void *amf_thread(void *arg) {
-    AMF *a = (AMF *)arg;
-
-    // Kết nối đến gNB
-    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_SCTP);
-    if (sock < 0) { perror("socket"); pthread_exit(NULL); }
+// chuyển request sang worker, chờ nếu queue của worker đầy
+static void dispatch_reqs(AmfWorker *w, int g, const Message *reqs, int n) {
+    while (n > 0) {
+        uint32_t k = ring_enqueue_burst(&w->q[g], reqs, n);
+        doorbell_ring(&w->bell);
+        reqs += k;
+        n -= k;
+        if (n > 0) sched_yield();
+    }
+}
 
+// nối tới gNB của l, gNB chưa listen thì thử lại mỗi CONNECT_RETRY_MS trong redial_ms
+// (0: thử mãi). Trả về socket đã nối hoặc -1
+static int gnb_dial(GnbLink *l) {
     struct sockaddr_in gnb_addr = {0};
     gnb_addr.sin_family = AF_INET;
-    gnb_addr.sin_port = htons(GNB_PORT);
+    gnb_addr.sin_port = htons(gnb_ports[l->idx]);
     inet_pton(AF_INET, GNB_IP, &gnb_addr.sin_addr);
 
-    if (connect(sock, (struct sockaddr*)&gnb_addr, sizeof(gnb_addr)) < 0) {
-        perror("connect gNB");
+    long long end = sim_now_us() + redial_ms * 1000LL;
+    while (1) {
+        int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_SCTP);
+        if (sock < 0) { perror("socket"); return -1; }
+        sctp_set_streams(sock, SCTP_STREAMS);
+        if (connect(sock, (struct sockaddr*)&gnb_addr, sizeof(gnb_addr)) == 0) return sock;
+        int err = errno;
         close(sock);
-        pthread_exit(NULL);
+        if (err != ECONNREFUSED || (redial_ms > 0 && sim_now_us() >= end)) {
+            errno = err;
+            perror("connect gNB");
+            return -1;
+        }
+        usleep(CONNECT_RETRY_MS * 1000);
     }
+}
 
-  
-    InitMessage init = { .msgid = MSG_INIT, .amf_id = a->amf_id, .capacity = a->capacity };
+// một association đã nối: gửi init / feature, nhận bản tin tới khi gNB đóng
+static void gnb_serve(GnbLink *l, int sock, Message (*stage)[BATCH_MAX], int *cnt) {
+    AMF *a = l->amf;
+    InitMessage init = { .msgid = MSG_INIT, .version = WIRE_VERSION, .amf_id = a->amf_id, .capacity = a->capacity };
+    wire_ctl_order(&init, sizeof(init));
     if (sctp_sendmsg(sock, &init, sizeof(init), NULL, 0, 0, 0, 0, 0, 0) < 0) {
         perror("send init");
-        close(sock);
-        pthread_exit(NULL);
+        return;
     }
 
-    a->sock_fd = sock;
-    printf("AMF%d: Connected to gNB on socket %d (cap=%d)\n",
-           a->amf_id+1, sock, a->capacity);
+    // đề nghị feature; chỉ bật khi gNB trả lại MSG_FEATURES (gNB cũ bỏ qua bản tin này)
+    FeatureMessage feat = { .msgid = MSG_FEATURES, .version = WIRE_VERSION, .features = AMF_FEATURES };
+    wire_ctl_order(&feat, sizeof(feat));
+    if (sctp_sendmsg(sock, &feat, sizeof(feat), NULL, 0, 0, 0, 0, 0, 0) < 0)
+        perror("send features");
+
+    int n_streams = sctp_streams(sock);
+    atomic_store(&l->features, 0);   // gNB khởi động lại có thể chấp nhận feature khác
+    atomic_store(&l->n_streams, n_streams);
+    atomic_store(&l->sock_fd, sock);   // sau cùng: worker thấy fd thì thấy cả số stream
+    printf("AMF%d: Connected to gNB%d (port %d) on socket %d (cap=%d, %d streams)\n",
+           a->amf_id+1, l->idx+1, gnb_ports[l->idx], sock, a->capacity, n_streams);
 
     // Vòng lặp xử lý bản tin
     while (1) {
-        Message req;
-        int r = sctp_recvmsg(sock, &req, sizeof(req), NULL, 0, NULL, NULL);
+        union {
+            Message m;
+            FeatureMessage feat;
+            BatchFrame frame;
+        } buf;
+        int r = sctp_recvmsg(sock, &buf, sizeof(buf), NULL, 0, NULL, NULL);
         if (r <= 0) {
-            printf("AMF%d: gNB closed connection\n", a->amf_id+1);
+            printf("AMF%d: gNB%d closed connection\n", a->amf_id+1, l->idx+1);
             break;
         }
 
-        if (req.msgid == MSG_RRC_NGAP_REQ) {
-            if (req.bitmask & BM_RANDOM_VALUE && a->current_load < a->capacity) {
-                uint64_t s = ((uint64_t)(a->amf_id & 0x3FF) << 30) |
-                             ((uint64_t)(a->amf_id & 0x3F) << 24) |
-                             (req.tmsi & 0xFFFFFF);
-
-                Message resp = {0};
-                resp.msgid = MSG_NGAP_RESP;
-                resp.bitmask = BM_RANDOM_VALUE;
-                resp.ue_id = req.ue_id;
-                resp.tmsi = req.tmsi;
-                resp.s_tmsi = s;
-
-                a->ue_s_tmsi[req.ue_id] = s;
-                a->ue_attach_time[req.ue_id] = current_millis(); // Lưu thời gian attach
-                a->ue_paging_delay[req.ue_id] = rand_step500(); // Random y
-                sctp_sendmsg(sock, &resp, sizeof(resp), NULL, 0, 0, 0, 0, 0, 0);
-
-                if (!a->registered_ues[req.ue_id]) {
-                    a->registered_ues[req.ue_id] = 1;
-                    a->current_load++;
-                    print_current_time();
-                    printf("AMF%d: current load = %d (%.2f%%)\n",
-                           a->amf_id+1, a->current_load,
-                           (float)a->current_load/NUM_UE*100.0f);
-                }
-            } else if (req.bitmask & BM_5G_STMSI) {
-                Message resp = {0};
-                resp.msgid = MSG_NGAP_RESP;
-                resp.bitmask = BM_5G_STMSI;
-                resp.ue_id = req.ue_id;
-                // if (a->ue_s_tmsi[req.ue_id] == 0) {
-                //     uint64_t s = ((uint64_t)(a->amf_id & 0x3FF) << 30) |
-                //                  ((uint64_t)(a->amf_id & 0x3F) << 24) |
-                //                  (req.tmsi & 0xFFFFFF);
-                //     a->ue_s_tmsi[req.ue_id] = s;
-                // }
-                resp.s_tmsi = a->ue_s_tmsi[req.ue_id];
-                sctp_sendmsg(sock, &resp, sizeof(resp), NULL, 0, 0, 0, 0, 0, 0);
-		printf("AMF%d: Service response for UE%d (S-TMSI=0x%llx, load unchanged)\n", a->amf_id+1, req.ue_id, (unsigned long long)resp.s_tmsi);
-            }
+        if (wire_is(&buf, r, MSG_FEATURES, sizeof(FeatureMessage))) {
+            wire_ctl_order(&buf.feat, sizeof(buf.feat));
+            uint32_t features = buf.feat.features & AMF_FEATURES;
+            atomic_store(&l->features, features);
+            printf("AMF%d: gNB%d features=0x%x\n", a->amf_id+1, l->idx+1, features);
+            continue;
+        }
+
+        // một datagram có thể là một Message hoặc một batch; chia theo worker sở hữu UE
+        Message *reqs;
+        int n = batch_view(&buf, r, &reqs);
+        memset(cnt, 0, a->n_workers * sizeof(int));
+        for (int k = 0; k < n; k++) {
+            int wi = amf_worker_of(&reqs[k], a->n_workers);
+            Message *m = &stage[wi][cnt[wi]++];
+            *m = reqs[k];
+            trace_stamp(&m->trace, HOP_AMF_RX);
+            lat_record_hops(LAT_GNB_TO_AMF, &m->trace, HOP_GNB_UL, HOP_AMF_RX);
+        }
+        for (int wi = 0; wi < a->n_workers; wi++)
+            if (cnt[wi] > 0) dispatch_reqs(&a->workers[wi], l->idx, stage[wi], cnt[wi]);
+    }
+
+    // worker thôi gửi trên association này
+    atomic_store(&l->sock_fd, -1);
+}
+
+/*
+ * Thread của mỗi association AMF - gNB: nhận bản tin và chia cho worker sở hữu UE.
+ * gNB đóng association (khởi động lại, hoặc khởi động sau AMF) thì nối lại trong
+ * redial_ms; hết hạn mà gNB không listen thì association coi như đóng hẳn.
+ * Worker có thể vẫn đang gửi trên fd cũ nên fd chỉ đóng trong main sau khi worker dừng
+ */
+void *gnb_link_thread(void *arg) {
+    GnbLink *l = (GnbLink *)arg;
+    AMF *a = l->amf;
+    Message (*stage)[BATCH_MAX] = malloc(a->n_workers * sizeof(*stage));
+    int *cnt = malloc(a->n_workers * sizeof(int));
+    if (!stage || !cnt) { perror("malloc"); exit(1); }
+
+    int sock;
+    while ((sock = gnb_dial(l)) >= 0) {
+        int *socks = realloc(l->socks, (l->n_socks + 1) * sizeof(int));
+        if (!socks) { perror("realloc"); exit(1); }
+        l->socks = socks;
+        l->socks[l->n_socks++] = sock;
+        gnb_serve(l, sock, stage, cnt);
+        printf("AMF%d: redialing gNB%d (port %d)\n", a->amf_id+1, l->idx+1, gnb_ports[l->idx]);
+    }
+    free(stage);
+    free(cnt);
+
+    atomic_fetch_sub(&a->n_up, 1);
+    for (int k = 0; k < a->n_workers; k++) doorbell_ring(&a->workers[k].bell);
+    return NULL;
+}
+
+// nạp lại context UE của worker từ file (-d): load của AMF và timer paging đang chờ
+static void restore_worker(AmfWorker *w) {
+    AMF *a = w->amf;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/amf%d-%dof%d.ctx", ctx_dir, a->amf_id + 1, w->idx, a->n_workers);
+    long long t0 = sim_now_us();
+    int n = ue_table_open(&w->ues, path);
+    if (n <= 0) return;
+    int registered = 0, timers = 0;
+    for (int k = 0; k < n; k++) {
+        UeContext *ue = ue_table_at(&w->ues, k);
+        if (!ue->registered) continue;
+        registered++;
+        if (ue->attach_time) {   // paging chưa gửi; quá hạn thì gửi ở tick đầu tiên
+            tw_add(&w->paging_wheel, &ue->paging_timer, ue->attach_time + ue->paging_delay);
+            timers++;
         }
     }
-     printf("AMF%d final: %d UEs (%.2f%%)\n", a->amf_id+1,a->current_load, (float)a->current_load/NUM_UE*100.0f);
-    close(sock);
-    a->sock_fd = -1;
-    pthread_exit(NULL);
-}
-
-int main() {
-    srand(time(NULL));
-    pthread_t tids[NUM_AMF];
-    int fixed_caps[NUM_AMF] = {40, 20, 30, 70, 40};  
-    for (int i = 0; i < NUM_AMF; i++) {
-        amfs[i].amf_id = i;
-        amfs[i].capacity = fixed_caps[i];
-        memset(amfs[i].registered_ues, 0, sizeof(amfs[i].registered_ues));
-        memset(amfs[i].ue_s_tmsi, 0, sizeof(amfs[i].ue_s_tmsi));
-        memset(amfs[i].ue_attach_time, 0, sizeof(amfs[i].ue_attach_time));
-        memset(amfs[i].ue_paging_delay, 0, sizeof(amfs[i].ue_paging_delay));
-        if (pthread_create(&tids[i], NULL, amf_thread, &amfs[i]) != 0) {
-            perror("pthread_create AMF");
+    atomic_fetch_add(&a->current_load, registered);
+    printf("AMF%d: worker %d restored %d UE contexts (%d registered, %d paging) in %.2f ms\n",
+           a->amf_id + 1, w->idx, n, registered, timers, (sim_now_us() - t0) / 1000.0);
+}
+
+static void start_workers(AMF *a) {
+    for (int k = 0; k < a->n_workers; k++) {
+        AmfWorker *w = &a->workers[k];
+        w->amf = a;
+        w->idx = k;
+        w->seed = base_seed ^ (a->amf_id << 8) ^ k;
+        w->q = aligned_alloc(CACHE_LINE, a->n_gnb * sizeof(MsgRing));
+        w->out = calloc(a->n_gnb * SCTP_STREAMS, sizeof(MsgBatch));
+        w->pages = calloc(a->n_gnb, sizeof(PagingList));
+        if (!w->q || !w->out || !w->pages) { perror("alloc worker"); exit(1); }
+        memset(w->q, 0, a->n_gnb * sizeof(MsgRing));
+        tw_init(&w->paging_wheel, current_millis());
+        ue_table_init(&w->ues, a->capacity / a->n_workers + 1);
+        if (ctx_dir) restore_worker(w);
+        if (pthread_create(&w->tid, NULL, amf_worker, w) != 0) {
+            perror("pthread_create worker");
             exit(1);
         }
     }
+}
 
-    // Thread gửi Paging
-    pthread_t tid_paging;
-    pthread_create(&tid_paging, NULL, paging_thread, NULL);
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-a num_amf] [-c cap1,cap2,...] [-w workers] [-u num_ue] [-s seed]\n"
+                    "          [-g gnb_port1,gnb_port2,...] [-r redial_ms] [-d ctx_dir]\n"
+                    "  -r: keep redialing a gNB that is not listening (yet, or after it\n"
+                    "      closed the association) for redial_ms, 0 = forever\n"
+                    "  -d: keep UE contexts in ctx_dir/amf<N>-<worker>of<workers>.ctx and\n"
+                    "      restore them on restart (same -a/-w to find the same files)\n", prog);
+    exit(1);
+}
 
-    for (int i = 0; i < NUM_AMF; i++) pthread_join(tids[i], NULL);
-    pthread_join(tid_paging, NULL);
+int main(int argc, char **argv) {
+    // capacity mặc định; -c ghi đè, AMF thiếu trong danh sách lấy capacity cuối
+    static int default_caps[] = {40, 20, 30, 70, 40};
+    int *caps = default_caps;
+    int n_caps = sizeof(default_caps) / sizeof(default_caps[0]);
+    int ch;
+    base_seed = (unsigned int)time(NULL);
+    while ((ch = getopt(argc, argv, "a:c:w:u:s:g:r:d:")) != -1) {
+        switch (ch) {
+        case 's': base_seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 'a': num_amf = atoi(optarg); break;
+        case 'w': n_workers = atoi(optarg); break;
+        case 'u': num_ue = atoi(optarg); break;
+        case 'c': {
+            caps = malloc((strlen(optarg) / 2 + 1) * sizeof(int));
+            n_caps = 0;
+            for (char *tok = strtok(optarg, ","); tok; tok = strtok(NULL, ","))
+                caps[n_caps++] = atoi(tok);
+            break;
+        }
+        case 'd': ctx_dir = optarg; break;
+        case 'r': redial_ms = atoi(optarg); break;
+        case 'g':
+            n_gnb = 0;
+            for (char *tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+                if (n_gnb == MAX_GNB) usage(argv[0]);
+                gnb_ports[n_gnb++] = atoi(tok);
+            }
+            break;
+        default: usage(argv[0]);
+        }
+    }
+    if (num_amf <= 0 || n_workers <= 0 || num_ue <= 0 || n_caps <= 0 || n_gnb <= 0 || redial_ms < 0) usage(argv[0]);
+
+    srand(base_seed);
+    lat_install_signals("amf");
+    log_init("amf");
+    amfs = calloc(num_amf, sizeof(AMF));
+    if (!amfs) { perror("calloc"); exit(1); }
+    for (int i = 0; i < num_amf; i++) {
+        AMF *a = &amfs[i];
+        a->amf_id = i;
+        a->capacity = caps[i < n_caps ? i : n_caps - 1];
+        a->n_workers = n_workers;
+        a->workers = aligned_alloc(CACHE_LINE, n_workers * sizeof(AmfWorker));
+        a->n_gnb = n_gnb;
+        a->links = calloc(n_gnb, sizeof(GnbLink));
+        if (!a->workers || !a->links) { perror("alloc AMF"); exit(1); }
+        memset(a->workers, 0, n_workers * sizeof(AmfWorker));
+        atomic_store(&a->n_up, n_gnb);
+        // link khởi tạo trước worker: paging khôi phục từ -d có thể đến hạn ngay
+        for (int g = 0; g < n_gnb; g++) {
+            GnbLink *l = &a->links[g];
+            l->amf = a;
+            l->idx = g;
+            atomic_init(&l->sock_fd, -1);
+            atomic_init(&l->n_streams, 1);
+            pthread_mutex_init(&l->page_lock, NULL);
+        }
+        start_workers(a);
+        for (int g = 0; g < n_gnb; g++) {
+            GnbLink *l = &a->links[g];
+            if (pthread_create(&l->tid, NULL, gnb_link_thread, l) != 0) {
+                perror("pthread_create AMF");
+                exit(1);
+            }
+        }
+    }
+
+    for (int i = 0; i < num_amf; i++) {
+        AMF *a = &amfs[i];
+        for (int g = 0; g < n_gnb; g++) pthread_join(a->links[g].tid, NULL);
+        printf("AMF%d final: %d UEs (%.2f%%)\n", a->amf_id+1, a->current_load, (float)a->current_load/num_ue*100.0f);
+        // dừng worker trước khi đóng socket để không gửi trên fd đã đóng
+        for (int k = 0; k < n_workers; k++) pthread_join(a->workers[k].tid, NULL);
+        for (int g = 0; g < n_gnb; g++) {
+            GnbLink *l = &a->links[g];
+            for (int k = 0; k < l->n_socks; k++) close(l->socks[k]);
+            free(l->socks);
+        }
+    }
 
     return 0;
 }
@@ -0,0 +1,318 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "sim_shm.h"
+
+/*
+ * Benchmark tái lập được cho bộ ba UE / gNB / AMF. Mỗi run:
+ *   ue_process -u N -s seed [-t traffic] [-S shards] [-P]  ->  đợi shm có magic  ->  gnb_process -m 10 -o summary
+ *   ->  amf_process -a .. -c .. -w .. -s seed,
+ * đợi gNB thoát (tất cả UE connected) hoặc timeout, rồi SIGTERM UE/AMF.
+ * -g G chạy G cặp UE/gNB (mỗi cặp N UE, shm và port riêng, TMSI không trùng)
+ * chung một AMF pool nối tới mọi gNB; run xong khi mọi gNB thoát.
+ * Kết quả (JSON, một file cho mọi run) gồm summary của gNB (attach/s, thời
+ * gian tới all-connected, sai lệch phân bổ UE so với capacity), CPU user/sys
+ * và max RSS của từng process, commit hiện tại, để so sánh giữa các commit.
+ * Run thứ k dùng seed + k. stdout, *.binlog của các process nằm trong logdir.
+ */
+#define BENCH_MONITOR_MS 10
+#define BENCH_POLL_MS 10
+#define BENCH_SHM_WAIT_MS 5000
+#define BENCH_TERM_WAIT_MS 2000
+#define BENCH_MAX_GNB 16
+#define BENCH_GNB_PORT 9100     // gNB thứ k listen ở BENCH_GNB_PORT + k
+
+typedef struct {
+    pid_t pid;
+    int status;          // -1: bị bench kill
+    struct rusage ru;
+    int done;
+} Proc;
+
+static long long now_ms(void) {
+    return sim_now_us() / 1000;
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+// fork/exec bindir/<name>_process trong logdir, stdout+stderr -> <tag>.out
+static pid_t spawn(const char *bindir, const char *logdir, const char *name, const char *tag, char **args) {
+    char path[PATH_MAX], out[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s_process", bindir, name);
+    snprintf(out, sizeof(out), "%s/%s.out", logdir, tag);
+    pid_t pid = fork();
+    if (pid < 0) { perror("fork"); exit(1); }
+    if (pid == 0) {
+        int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) { dup2(fd, 1); dup2(fd, 2); close(fd); }
+        if (chdir(logdir) < 0) { perror("chdir"); _exit(127); }
+        args[0] = path;
+        execv(path, args);
+        perror(path);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void reap(Proc *p, int block);
+
+// UE process tạo xong shm (magic ghi sau cùng)
+static int wait_shm(Proc *ue, const char *shm_name, int timeout_ms) {
+    long long end = now_ms() + timeout_ms;
+    while (now_ms() < end) {
+        reap(ue, 0);
+        if (ue->done) return -1;
+        int fd = shm_open(shm_name, O_RDONLY, 0);
+        if (fd >= 0) {
+            ShmHeader *h = mmap(NULL, sizeof(ShmHeader), PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (h != MAP_FAILED) {
+                int ok = atomic_load_explicit(&h->magic, memory_order_acquire) == SHM_MAGIC;
+                munmap(h, sizeof(ShmHeader));
+                if (ok) return 0;
+            }
+        }
+        sleep_ms(BENCH_POLL_MS);
+    }
+    return -1;
+}
+
+static void reap(Proc *p, int block) {
+    if (p->done || p->pid <= 0) return;
+    int st;
+    if (wait4(p->pid, &st, block ? 0 : WNOHANG, &p->ru) == p->pid) {
+        p->done = 1;
+        if (p->status != -1) p->status = WIFEXITED(st) ? WEXITSTATUS(st) : 128 + WTERMSIG(st);
+    }
+}
+
+// SIGTERM rồi SIGKILL nếu process không thoát trong BENCH_TERM_WAIT_MS
+static void stop(Proc *p) {
+    if (p->done || p->pid <= 0) return;
+    kill(p->pid, SIGTERM);
+    long long end = now_ms() + BENCH_TERM_WAIT_MS;
+    while (!p->done && now_ms() < end) {
+        reap(p, 0);
+        if (!p->done) sleep_ms(BENCH_POLL_MS);
+    }
+    if (!p->done) {
+        p->status = -1;
+        kill(p->pid, SIGKILL);
+        reap(p, 1);
+    }
+}
+
+static double tv_s(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// chép nguyên file JSON (summary của gNB) vào output, "null" nếu không có
+static void copy_json(FILE *out, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) { fputs("null", out); return; }
+    char buf[4096];
+    size_t n, total = 0;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        while (n > 0 && buf[n - 1] == '\n') n--;
+        fwrite(buf, 1, n, out);
+        total += n;
+    }
+    if (total == 0) fputs("null", out);
+    fclose(f);
+}
+
+static void git_commit(char *out, size_t len) {
+    snprintf(out, len, "unknown");
+    FILE *p = popen("git rev-parse --short HEAD 2>/dev/null", "r");
+    if (!p) return;
+    if (fgets(out, (int)len, p)) out[strcspn(out, "\n")] = 0;
+    if (!out[0]) snprintf(out, len, "unknown");
+    pclose(p);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-u num_ue] [-g num_gnb] [-a num_amf] [-c cap1,cap2,...] [-l lb] [-w workers]\n"
+                    "       [-T traffic_spec] [-S ue_shards] [-P]"
+                    " [-s seed] [-r runs] [-t timeout_s] [-b bindir] [-d logdir] [-o results.json]\n"
+                    "  -u: UEs per gNB; -g: UE/gNB pairs sharing one AMF pool (max %d)\n", prog, BENCH_MAX_GNB);
+    exit(1);
+}
+
+// tên riêng của cặp UE/gNB thứ k: cặp đầu giữ tên mặc định, log của run một gNB không đổi
+static void pair_name(char *buf, size_t n, const char *base, int k, int n_gnb) {
+    if (n_gnb == 1) snprintf(buf, n, "%s", base);
+    else snprintf(buf, n, "%s%d", base, k + 1);
+}
+
+// proc của một process trong JSON, null nếu chưa được khởi động
+static void put_proc(FILE *out, const char *sep, const char *name, const Proc *p) {
+    if (p->pid <= 0) { fprintf(out, "%s\"%s\":null", sep, name); return; }
+    fprintf(out, "%s\"%s\":{\"exit\":%d,\"cpu_user_s\":%.3f,\"cpu_sys_s\":%.3f,\"maxrss_kb\":%ld}",
+            sep, name, p->status, tv_s(p->ru.ru_utime), tv_s(p->ru.ru_stime), p->ru.ru_maxrss);
+}
+
+int main(int argc, char **argv) {
+    const char *num_ue = "200", *num_amf = "5", *caps = NULL, *lb = "swrr", *workers = NULL;
+    const char *traffic = NULL, *ue_shards = NULL, *bindir = ".", *logdir = "bench_logs", *out_path = "bench.json";
+    unsigned long seed = 1;
+    int runs = 1, timeout_s = 60, ue_procs = 0, n_gnb = 1, ch;
+    while ((ch = getopt(argc, argv, "u:g:a:c:l:w:T:S:Ps:r:t:b:d:o:")) != -1) {
+        switch (ch) {
+        case 'u': num_ue = optarg; break;
+        case 'g': n_gnb = atoi(optarg); break;
+        case 'a': num_amf = optarg; break;
+        case 'c': caps = optarg; break;
+        case 'l': lb = optarg; break;
+        case 'w': workers = optarg; break;
+        case 'T': traffic = optarg; break;
+        case 'S': ue_shards = optarg; break;
+        case 'P': ue_procs = 1; break;
+        case 's': seed = strtoul(optarg, NULL, 0); break;
+        case 'r': runs = atoi(optarg); break;
+        case 't': timeout_s = atoi(optarg); break;
+        case 'b': bindir = optarg; break;
+        case 'd': logdir = optarg; break;
+        case 'o': out_path = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (runs <= 0 || timeout_s <= 0 || n_gnb <= 0 || n_gnb > BENCH_MAX_GNB) usage(argv[0]);
+
+    // child chdir vào logdir nên cần đường dẫn tuyệt đối
+    char bin_abs[PATH_MAX], log_abs[PATH_MAX], commit[64];
+    if (mkdir(logdir, 0755) < 0 && errno != EEXIST) { perror("mkdir logdir"); exit(1); }
+    if (!realpath(bindir, bin_abs) || !realpath(logdir, log_abs)) { perror("realpath"); exit(1); }
+    git_commit(commit, sizeof(commit));
+    signal(SIGPIPE, SIG_IGN);
+
+    // tham số riêng của từng cặp: shm, port gNB, offset UE, file summary, tên log
+    char shm_names[BENCH_MAX_GNB][64], ports[BENCH_MAX_GNB][8], offsets[BENCH_MAX_GNB][16];
+    char summaries[BENCH_MAX_GNB][PATH_MAX + 32], ue_tags[BENCH_MAX_GNB][16], gnb_tags[BENCH_MAX_GNB][16];
+    char amf_ports[BENCH_MAX_GNB * 8], amf_ues[16];
+    amf_ports[0] = 0;
+    for (int k = 0; k < n_gnb; k++) {
+        pair_name(shm_names[k], sizeof(shm_names[k]), SHM_NAME, k, n_gnb);
+        snprintf(ports[k], sizeof(ports[k]), "%d", BENCH_GNB_PORT + k);
+        snprintf(offsets[k], sizeof(offsets[k]), "%ld", (long)k * atoi(num_ue));
+        pair_name(ue_tags[k], sizeof(ue_tags[k]), "ue", k, n_gnb);
+        pair_name(gnb_tags[k], sizeof(gnb_tags[k]), "gnb", k, n_gnb);
+        snprintf(summaries[k], sizeof(summaries[k]), "%s/%s_summary.json", log_abs, gnb_tags[k]);
+        snprintf(amf_ports + strlen(amf_ports), sizeof(amf_ports) - strlen(amf_ports), "%s%s", k ? "," : "", ports[k]);
+    }
+    snprintf(amf_ues, sizeof(amf_ues), "%d", atoi(num_ue) * n_gnb);
+
+    FILE *out = fopen(out_path, "w");
+    if (!out) { perror(out_path); exit(1); }
+    fprintf(out, "{\"commit\":\"%s\",\"num_ue\":%d,\"num_gnb\":%d,\"num_amf\":%d,\"capacity\":\"%s\",\"lb\":\"%s\","
+                 "\"workers\":\"%s\",\"traffic\":\"%s\",\"ue_shards\":%d,\"ue_procs\":%d,\"seed\":%lu,\"runs\":[\n",
+            commit, atoi(num_ue), n_gnb, atoi(num_amf), caps ? caps : "", lb, workers ? workers : "",
+            traffic ? traffic : "", ue_shards ? atoi(ue_shards) : 1, ue_procs, seed);
+
+    int failed = 0;
+    for (int r = 0; r < runs; r++) {
+        char seed_s[24];
+        snprintf(seed_s, sizeof(seed_s), "%lu", seed + r);
+        Proc ue[BENCH_MAX_GNB], gnb[BENCH_MAX_GNB], amf;
+        memset(ue, 0, sizeof(ue));
+        memset(gnb, 0, sizeof(gnb));
+        memset(&amf, 0, sizeof(amf));
+        for (int k = 0; k < n_gnb; k++) {
+            unlink(summaries[k]);
+            shm_unlink(shm_names[k]);   // magic cũ không được lọt qua wait_shm
+        }
+
+        long long t0 = now_ms();
+        int timed_out = 0, started = 1;
+        for (int k = 0; k < n_gnb && started; k++) {
+            char *ue_args[16] = { NULL, "-u", (char *)num_ue, "-s", seed_s,
+                                  "-n", shm_names[k], "-o", offsets[k] };
+            int a = 9;
+            if (traffic) { ue_args[a++] = "-t"; ue_args[a++] = (char *)traffic; }
+            if (ue_shards) { ue_args[a++] = "-S"; ue_args[a++] = (char *)ue_shards; }
+            if (ue_procs) ue_args[a++] = "-P";
+            ue_args[a] = NULL;
+            ue[k].pid = spawn(bin_abs, log_abs, "ue", ue_tags[k], ue_args);
+            if (wait_shm(&ue[k], shm_names[k], BENCH_SHM_WAIT_MS) < 0) {
+                fprintf(stderr, "bench: run %d: UE process %d did not create shm\n", r, k + 1);
+                started = 0;
+            }
+        }
+        if (started) {
+            char mon[16];
+            snprintf(mon, sizeof(mon), "%d", BENCH_MONITOR_MS);
+            for (int k = 0; k < n_gnb; k++) {
+                char *gnb_args[] = { NULL, "-a", (char *)num_amf, "-l", (char *)lb, "-s", seed_s,
+                                     "-m", mon, "-o", summaries[k], "-p", ports[k], "-n", shm_names[k], NULL };
+                gnb[k].pid = spawn(bin_abs, log_abs, "gnb", gnb_tags[k], gnb_args);
+            }
+            char *amf_args[16] = { NULL, "-a", (char *)num_amf, "-u", amf_ues, "-s", seed_s, "-g", amf_ports };
+            int k = 9;
+            if (caps) { amf_args[k++] = "-c"; amf_args[k++] = (char *)caps; }
+            if (workers) { amf_args[k++] = "-w"; amf_args[k++] = (char *)workers; }
+            amf_args[k] = NULL;
+            amf.pid = spawn(bin_abs, log_abs, "amf", "amf", amf_args);
+
+            // gNB tự thoát khi mọi UE của nó connected
+            long long end = t0 + timeout_s * 1000LL;
+            int running = n_gnb;
+            while (running > 0 && now_ms() < end) {
+                running = 0;
+                for (int g = 0; g < n_gnb; g++) {
+                    reap(&gnb[g], 0);
+                    running += !gnb[g].done;
+                }
+                if (running) sleep_ms(BENCH_POLL_MS);
+            }
+            for (int g = 0; g < n_gnb; g++) {
+                if (gnb[g].done) continue;
+                timed_out = 1;
+                stop(&gnb[g]);
+            }
+        }
+        double wall_s = (now_ms() - t0) / 1e3;
+        stop(&amf);
+        int ok = started && !timed_out;
+        for (int k = 0; k < n_gnb; k++) {
+            stop(&ue[k]);
+            shm_unlink(shm_names[k]);
+            ok &= gnb[k].done && gnb[k].status == 0;
+        }
+        if (!ok) failed++;
+
+        fprintf(out, "%s{\"run\":%d,\"seed\":%lu,\"status\":\"%s\",\"wall_s\":%.3f,\"gnb\":",
+                r ? ",\n" : "", r, seed + r, timed_out ? "timeout" : ok ? "ok" : "error", wall_s);
+        // một gNB: summary như trước; nhiều gNB: mảng summary theo thứ tự cặp
+        if (n_gnb > 1) fputc('[', out);
+        for (int k = 0; k < n_gnb; k++) {
+            if (k) fputc(',', out);
+            copy_json(out, summaries[k]);
+        }
+        if (n_gnb > 1) fputc(']', out);
+        fputs(",\"proc\":{", out);
+        for (int k = 0; k < n_gnb; k++) put_proc(out, k ? "," : "", ue_tags[k], &ue[k]);
+        for (int k = 0; k < n_gnb; k++) put_proc(out, ",", gnb_tags[k], &gnb[k]);
+        put_proc(out, ",", "amf", &amf);
+        fputs("}}", out);
+        fflush(out);
+        printf("bench: run %d seed %lu: %s, %.3fs\n", r, seed + r,
+               timed_out ? "timeout" : ok ? "ok" : "error", wall_s);
+    }
+    fputs("\n]}\n", out);
+    fclose(out);
+    printf("bench: %d/%d runs ok, results in %s\n", runs - failed, runs, out_path);
+    return failed ? 1 : 0;
+}
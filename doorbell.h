@@ -0,0 +1,68 @@
+#ifndef DOORBELL_H
+#define DOORBELL_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "sim_util.h"
+
+#ifndef SPIN_POLL_US
+#define SPIN_POLL_US 0     // > 0: busy-poll bao nhiêu us trước khi ngủ futex
+#endif
+
+/*
+ * Doorbell: futex word dùng để đánh thức thread đang chờ việc.
+ * Có thể đặt trong shared memory (futex không PRIVATE nên chạy được
+ * giữa các process). Producer tăng seq rồi mới wake nếu có waiter.
+ * Consumer đọc seq trước khi kiểm tra việc, rồi chờ với seq đó.
+ */
+typedef struct {
+    _Alignas(64) _Atomic uint32_t seq;
+    _Atomic uint32_t waiters;
+} Doorbell;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+static long doorbell_spin_us = SPIN_POLL_US;
+
+static inline uint32_t doorbell_seq(Doorbell *d) {
+    return atomic_load(&d->seq);
+}
+
+static inline void doorbell_ring(Doorbell *d) {
+    atomic_fetch_add(&d->seq, 1);
+    if (atomic_load(&d->waiters))
+        syscall(SYS_futex, &d->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// chờ đến khi seq khác seen hoặc hết timeout_ms (timeout_ms < 0: chờ mãi)
+static inline void doorbell_wait(Doorbell *d, uint32_t seen, long timeout_ms) {
+    if (timeout_ms == 0) return;
+    if (doorbell_spin_us > 0) {
+        long long end = sim_now_us() + doorbell_spin_us;
+        do {
+            if (atomic_load_explicit(&d->seq, memory_order_acquire) != seen) return;
+            cpu_relax();
+        } while (sim_now_us() < end);
+    }
+    struct timespec ts, *tp = NULL;
+    if (timeout_ms > 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        tp = &ts;
+    }
+    atomic_fetch_add(&d->waiters, 1);
+    if (atomic_load(&d->seq) == seen)
+        syscall(SYS_futex, &d->seq, FUTEX_WAIT, seen, tp, NULL, 0);
+    atomic_fetch_sub(&d->waiters, 1);
+}
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,82 +6,113 @@
 #include <stdint.h>
 #include <pthread.h>
 #include <arpa/inet.h>
-#include <sys/mman.h>
-#include <fcntl.h>
 #include <time.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <stdatomic.h>
 #include <errno.h>
 #include <netinet/sctp.h>
 #include <sys/time.h>
+#include <sched.h>
+#include "sim_msg.h"
+#include "sim_shm.h"
+#include "ngap_batch.h"
+#include "sctp_stream.h"
+#include "amf_lb.h"
+#include "load_report.h"
+#include "timer_wheel.h"
+#include "latency_hist.h"
+#include "log.h"
+#include "sweep_simd.h"
+#include "token_bucket.h"
 
-#define NUM_UE 200
-#define NUM_AMF 5
-#define SHM_NAME "/5g_sim_shm"
-#define SHM_SIZE (sizeof(SharedMemory))
-#define GNB_LISTEN_PORT 9100   // gNB listen cho AMF
-
-#define MSG_UE_RRC_CONNECTION_REQUEST 0x10
-#define MSG_RRC_UE_CONNECTION_RESPONSE 0x11
-#define MSG_RRC_NGAP_REQ              0x12
-#define MSG_NGAP_RESP                 0x13
-#define MSG_NGAP_RRC_PAGING           0x14
-#define MSG_RRC_UE_PAGING             0x15
-#define MSG_INIT                      0x09  
-
-#define BM_RANDOM_VALUE 0x01
-#define BM_5G_STMSI     0x02
+#define DEFAULT_NUM_AMF 5
+#define GNB_LISTEN_PORT 9100   // gNB listen cho AMF, -p khi chạy nhiều gNB
+#define GNB_FEATURES (FEAT_BATCH | FEAT_LOAD_REPORT | FEAT_PAGING_LIST) // feature gNB chấp nhận khi AMF đề nghị
+#define NGAP_REQ_TIMEOUT_MS 1000  // không có response trong khoảng này -> reject timeout cho UE
+#define AMF_REJOIN_GRACE_MS 3000  // AMF rời: giữ UE đã gán chừng này chờ AMF khởi động lại (-r)
+#define FAILOVER_RATE 2000        // UE/s được báo đăng ký lại khi AMF chết (-F, 0: không giới hạn)
+#define ADMIT_RATE_GLOBAL 0       // request/s gửi tới tất cả AMF (-R, 0: không giới hạn)
+#define ADMIT_RATE_AMF 0          // request/s gửi tới mỗi AMF (-A, 0: không giới hạn)
+#define ADMIT_BACKLOG 4096        // request chờ token tối đa mỗi AMF mỗi lớp (-B), đầy thì reject
+#define ADMIT_MAX_WAIT_MS 500     // chờ token lâu hơn thì reject overload, UE backoff rồi gửi lại
+#define REDIRECT_RETRIES 64       // redirect_q đầy: số lần thử trước khi trả reject thẳng cho UE
+#define RING_WAIT_MS 100          // ring DL của shard đầy lâu hơn (UE process không đọc) thì bỏ bản tin
+#define AMF_SEND_TIMEOUT_MS 1000  // AMF không nhận thêm trong khoảng này thì coi như gửi lỗi
+#define MAX_REDIRECTS 3           // số lần chuyển AMF khi bị reject trước khi trả reject cho UE
+#define MONITOR_PRINT_MS 1000     // in trạng thái mỗi giây dù monitor poll dày hơn
 
 enum UE_State{
     UE_IDLE,
     UE_REGISTERED,
     UE_CONNECTED
 };
-typedef struct {
-    uint8_t msgid;
-    uint8_t bitmask;
-    uint16_t ue_id;
-    uint64_t tmsi;
-    uint64_t s_tmsi;
-} Message;
-
-// Mới: Struct cho init message từ AMF
-typedef struct {
-    uint8_t msgid;  // 0x01
-    int amf_id;
-    int capacity;
-} InitMessage;
-
-typedef struct {
-    pthread_mutex_t mutex;
-    Message ul[NUM_UE];
-    int ul_ready[NUM_UE];
-    Message dl[NUM_UE];
-    int dl_ready[NUM_UE];
-    int ue_states[NUM_UE];
-} SharedMemory;
 
 // Struct quản lý kết nối của các AMF
 typedef struct {
     int amf_id;
-    int sock_fd;
+    _Atomic int sock_fd;               // downlink thread ghi khi join/leave, uplink thread đọc
+    _Atomic uint32_t features;         // feature đã thỏa thuận qua MSG_FEATURES
+    _Atomic int n_streams;             // số stream đã thỏa thuận với AMF
+    _Atomic int in_grace;              // AMF vừa rời, UE của nó chờ AMF kết nối lại
+    unsigned long long grace_until;    // ms, downlink thread sở hữu
+    _Atomic int failed;                // AMF bị coi là chết, uplink thread chuyển UE đi
+    _Atomic long long down_us;         // lúc association đóng
 } AmfConn;
 
+// một lần failover: UE của AMF chết được chuyển sang AMF còn sống
+typedef struct {
+    long long down_us;      // association đóng
+    long long start_us;     // bắt đầu chuyển UE (hết grace)
+    _Atomic long long done_us;
+    _Atomic int total;      // số UE phải chuyển
+    _Atomic int done;       // số UE đã đăng ký lại ở AMF khác
+    _Atomic uint16_t gen;   // lần failover thứ mấy của AMF, UE của lần trước không tính vào lần này
+} FailoverStat;
+
 SharedMemory *shm = NULL;
-AmfConn amf_conns[NUM_AMF];
+uint8_t *ue_states;          // trong shm, UE ghi, 1 byte/UE
+int num_ue;                   // đọc từ header shm do UE process tạo
+int num_amf = DEFAULT_NUM_AMF;
+AmfConn *amf_conns;
+
+int *ue_to_amf;               // Lưu AMF idx được gán cho UE
+AmfLb lb;                     // count/capacity/weight của các AMF và chiến lược chọn AMF
+LbStrategy lb_strategy = LB_SWRR;
+pthread_mutex_t amf_lock = PTHREAD_MUTEX_INITIALIZER;  // bảo vệ bảng AMF và lb
+_Atomic int amf_epoch;         // tăng mỗi khi có AMF join (hoặc hết grace)
+int rejoin_grace_ms = AMF_REJOIN_GRACE_MS;
+int failover_rate = FAILOVER_RATE;
+FailoverStat *failover;       // num_amf, lần failover gần nhất của mỗi AMF
+
+// fd của AMF đã rời, chờ uplink thread đóng (bảo vệ bởi amf_lock): uplink thread đọc
+// sock_fd không khóa và có thể còn đang gửi trên fd cũ, đóng ngay thì accept4 có thể
+// cấp lại số fd đó cho association mới và batch cũ đi nhầm AMF
+static int *closing_fds;
+static int n_closing_alloc;
+static _Atomic int n_closing;
+
+int listen_fd = -1;
+int epfd = -1;
+
+// số liệu cho benchmark (-o): thời điểm UL đầu tiên, đủ attach, đủ connected
+static _Atomic long long t_first_ul_us;
+static _Atomic long long t_attached_us;
+static _Atomic int n_attached;
+static uint8_t *ue_attached;          // downlink thread sở hữu
+static const char *lb_name = "swrr";
 
-int ue_to_amf[NUM_UE];        // Lưu AMF idx được gán cho UE
-int amf_counts[NUM_AMF];      // Lưu số lượng UE phân bổ tại các AMF
-int amf_capacity[NUM_AMF] = {0};  // lưu dung lượng tối đa của các AMF
-int amf_weight[NUM_AMF] = {0};    
-int amf_current_weight[NUM_AMF];   
+// epoll data cho mỗi association AMF; amf = -1 khi chưa nhận init
+typedef struct {
+    int fd;
+    int amf;
+} AmfPeer;
 
 
-void init_shm() {
-    int fd = shm_open(SHM_NAME, O_RDWR, 0666);
-    if (fd < 0) { perror("gNB shm_open"); exit(1); }
-    shm = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (shm == MAP_FAILED) { perror("gNB mmap"); exit(1); }
-    close(fd);
+static void *xcalloc(size_t n, size_t sz) {
+    void *p = calloc(n, sz);
+    if (!p) { perror("gNB calloc"); exit(1); }
+    return p;
 }
 
 void print_current_time() {
@@ -93,237 +125,1019 @@ void print_current_time() {
     printf("[Time] %s:%06ld\n", buff, tv.tv_usec);
 }
 
-// hàm lựa chọn AMF để foward UL req từ UE
-int pick_amf_wrr() {
-    int total = 0;
-    for (int i = 0; i < NUM_AMF; i++) total += amf_weight[i];
-    int best_i = -1;
-    int best_val = -2147483648;  // INT32_MIN
-    for (int i = 0; i < NUM_AMF; i++) {
-        amf_current_weight[i] += amf_weight[i];
-        if (amf_current_weight[i] > best_val && amf_counts[i] < amf_capacity[i]) {
-            best_val = amf_current_weight[i];
-            best_i = i;
+// gửi tới AMF trên socket non-blocking, chờ POLLOUT nếu send buffer đầy,
+// tối đa AMF_SEND_TIMEOUT_MS (AMF treo thì trả lỗi ETIMEDOUT, không giữ thread vô hạn)
+static int amf_send(int fd, const void *buf, size_t len, uint16_t stream) {
+    long long deadline = 0;
+    while (1) {
+        int r = sctp_sendmsg(fd, buf, len, NULL, 0, 0, 0, stream, 0, 0);
+        if (r >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) return r;
+        long long now = sim_now_us();
+        if (!deadline) {
+            deadline = now + AMF_SEND_TIMEOUT_MS * 1000LL;
+        } else if (now >= deadline) {
+            errno = ETIMEDOUT;
+            return -1;
         }
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        poll(&pfd, 1, 100);
     }
-    if (best_i >= 0) {
-        amf_current_weight[best_i] -= total;
-    } else {
-        for (int i = 0; i < NUM_AMF; i++) {
-            if (amf_counts[i] < amf_capacity[i]) {
-                best_i = i;
-                break;
+}
+
+// =============== UPLINK THREAD ===============
+MsgBatch *ul_batch;  // num_amf * SCTP_STREAMS batch NGAP req theo AMF/stream, do uplink thread sở hữu
+#define UL_BATCH(amf, st) (&ul_batch[(amf) * SCTP_STREAMS + (st)])
+
+// gửi batch của một stream; lỗi thì bỏ gán AMF cho các UE trong batch để lần UL sau chọn lại
+static void flush_ul_batch(int amf, int stream) {
+    MsgBatch *b = UL_BATCH(amf, stream);
+    int n = b->count;
+    if (n == 0) return;
+    int fd = atomic_load(&amf_conns[amf].sock_fd);
+    uint32_t features = atomic_load(&amf_conns[amf].features);
+    if (fd > 0 && batch_flush(b, fd, features, stream, amf_send) >= 0) return;
+    if (fd > 0) perror("uplink send");
+    b->count = 0;
+    pthread_mutex_lock(&amf_lock);
+    for (int k = 0; k < n; k++) {
+        int uid = b->frame.msgs[k].ue_id;
+        if (ue_to_amf[uid] == amf) {
+            ue_to_amf[uid] = -1;
+            lb_release(&lb, amf);
+        }
+    }
+    pthread_mutex_unlock(&amf_lock);
+}
+
+// reject từ AMF: downlink thread (producer) -> uplink thread (consumer)
+static MsgRing redirect_q;
+// timeout request, do uplink thread sở hữu
+static TimerWheel req_wheel;
+static TimerNode *req_timer;          // num_ue
+static _Atomic uint8_t *req_pending;  // bitmask request đang chờ response, downlink xóa khi có response/reject
+static uint8_t *redirects;            // số lần đã chuyển AMF cho request hiện tại
+
+static unsigned long long now_ms(void) {
+    return (unsigned long long)(sim_now_us() / 1000);
+}
+
+static _Atomic long dl_drops;   // bản tin DL bỏ vì ring của shard đầy quá RING_WAIT_MS
+
+/*
+ * Đẩy m vào ring r của shard sh, chờ UE đọc tối đa RING_WAIT_MS. Quá hạn thì bỏ
+ * bản tin và đánh dấu shard trong *stalled (bitmap của thread producer): các lần
+ * sau gặp ring đầy bỏ ngay, không chờ lại, cho tới khi ring nhận được bản tin.
+ * Trả về 1 nếu đã đẩy
+ */
+static int shard_push(ShmShard *sh, MsgRing *r, const Message *m, uint64_t *stalled) {
+    uint64_t bit = 1ULL << (sh - shm->shard);
+    long long deadline = 0;
+    while (!ring_enqueue(r, m)) {
+        long long now = sim_now_us();
+        if (!deadline) {
+            deadline = now + RING_WAIT_MS * 1000LL;
+        } else if ((*stalled & bit) || now >= deadline) {
+            *stalled |= bit;
+            atomic_fetch_add(&dl_drops, 1);
+            LOG_WRN("gNB: DL ring of UE%d full, dropped msgid=0x%x", m->ue_id, m->msgid);
+            return 0;
+        }
+        doorbell_ring(&sh->dl_bell);
+        sched_yield();
+    }
+    *stalled &= ~bit;
+    return 1;
+}
+
+static uint64_t ctl_stalled;   // shard có dl_ctl đầy quá hạn, uplink thread sở hữu
+
+// gửi reject cho UE qua ring dl_ctl của shard (uplink thread là producer duy nhất)
+static void push_ctl(int i, int cause) {
+    Message rej = { .msgid = MSG_RRC_UE_REJECT, .version = WIRE_VERSION, .cause = cause, .ue_id = i };
+    ShmShard *sh = shm_shard_of(shm, i);
+    if (shard_push(sh, &sh->dl_ctl, &rej, &ctl_stalled)) doorbell_ring(&sh->dl_bell);
+}
+
+static void reject_ue(int i, int cause) {
+    push_ctl(i, cause);
+    LOG_WRN("gNB: Rejected UE%d (cause=%d), UE will back off", i, cause);
+}
+
+// request UL của UE có AMF đang trong grace, thử lại khi AMF join lại (hoặc hết grace).
+// AMF không quay lại thì UE được báo đăng ký lại qua migrate_q (failover_tb), request bị bỏ
+static Message deferred[RING_CAP];
+static int deferred_amf[RING_CAP];   // AMF mà request đang chờ
+static int n_deferred;
+
+// bỏ gán AMF hiện tại của UE và trả slot cho lb
+static void unassign_ue(int i) {
+    int amf = ue_to_amf[i];
+    if (amf < 0) return;
+    pthread_mutex_lock(&amf_lock);
+    lb_release(&lb, amf);
+    pthread_mutex_unlock(&amf_lock);
+    ue_to_amf[i] = -1;
+}
+
+/*
+ * Admission control: request đã chọn AMF phải lấy một token ở bucket của AMF
+ * đó và một token ở bucket chung trước khi vào batch. Hết token thì request
+ * chờ trong hàng của AMF theo lớp: UE đã đăng ký (BM_5G_STMSI, service request
+ * / đăng ký lại) đi trước attach mới (BM_RANDOM_VALUE). Hàng có giới hạn
+ * admit_backlog; hàng đầy hoặc chờ quá ADMIT_MAX_WAIT_MS thì reject
+ * CAUSE_OVERLOAD, UE backoff (exponential + jitter) rồi gửi lại. Như vậy tốc độ
+ * tới AMF không vượt quá rate dù UE dồn tới, độ trễ ở AMF giữ phẳng, phần dư
+ * nằm ở gNB/UE. Mọi thứ do uplink thread sở hữu.
+ */
+enum { ADMIT_HI, ADMIT_LO, ADMIT_CLASSES };
+static const char *admit_class_name[ADMIT_CLASSES] = { "stmsi", "attach" };
+
+typedef struct {
+    Message *msg;                // admit_backlog
+    unsigned long long *t_ms;    // lúc vào hàng
+    uint32_t head, tail;
+} AdmitQueue;
+
+typedef struct {
+    long sent;      // gửi tới AMF (ngay hoặc sau khi chờ)
+    long queued;    // số lần phải chờ token
+    long shed;      // reject overload
+} AdmitStat;
+
+int admit_rate_global = ADMIT_RATE_GLOBAL;
+int admit_rate_amf = ADMIT_RATE_AMF;
+int admit_backlog = ADMIT_BACKLOG;
+static TokenBucket admit_tb;           // chung cho mọi AMF
+static TokenBucket *amf_tb;            // num_amf
+static AdmitQueue *admit_q;            // num_amf * ADMIT_CLASSES
+#define ADMIT_Q(amf, c) (&admit_q[(amf) * ADMIT_CLASSES + (c)])
+static int admit_waiting[ADMIT_CLASSES];   // tổng request đang chờ của mỗi lớp
+static AdmitStat admit_stat[ADMIT_CLASSES];
+static uint8_t admit_global_starved[ADMIT_CLASSES];  // lượt drain vừa rồi lớp này còn chờ vì hết token chung
+static int admit_rr;                   // AMF được phục vụ đầu tiên ở lượt drain kế tiếp
+
+static int admit_class(const Message *m) {
+    return (m->bitmask & BM_5G_STMSI) ? ADMIT_HI : ADMIT_LO;
+}
+
+// đưa NGAP request vào batch của AMF, bắt đầu chờ response
+static void send_req(int amf, Message *m) {
+    int i = m->ue_id;
+    // các bản tin của một UE luôn đi cùng stream
+    int st = ue_stream(i, atomic_load(&amf_conns[amf].n_streams));
+    atomic_store(&req_pending[i], m->bitmask);
+    tw_add(&req_wheel, &req_timer[i], now_ms() + NGAP_REQ_TIMEOUT_MS);
+    if (batch_add(UL_BATCH(amf, st), m)) flush_ul_batch(amf, st);
+    admit_stat[admit_class(m)].sent++;
+
+    LOG_INF("gNB: Forwarded uplink req from UE%d to AMF%d", i, amf + 1);
+}
+
+// lấy tối đa want token ở cả bucket của AMF và bucket chung
+static int admit_take(int amf, int want, long long now_us) {
+    int n = want;
+    int a = tb_avail(&amf_tb[amf], now_us), g = tb_avail(&admit_tb, now_us);
+    if (a < n) n = a;
+    if (g < n) n = g;
+    tb_take(&amf_tb[amf], now_us, n);
+    tb_take(&admit_tb, now_us, n);
+    return n;
+}
+
+// bỏ request: attach trả slot AMF để lần gửi lại chọn lại
+static void admit_shed(const Message *m, int cause) {
+    if (m->bitmask & BM_RANDOM_VALUE) unassign_ue(m->ue_id);
+    admit_stat[admit_class(m)].shed++;
+    reject_ue(m->ue_id, cause);
+}
+
+static uint32_t admit_queued(int amf, int c) {
+    return ADMIT_Q(amf, c)->tail - ADMIT_Q(amf, c)->head;
+}
+
+// gửi ngay nếu đủ token và không có request cùng lớp / lớp cao hơn chờ trước: trong hàng của
+// chính AMF này (bucket riêng), hoặc đang thiếu token chung (bucket chung). Hàng của AMF khác
+// chỉ chờ bucket riêng của nó thì không chặn AMF này. Không thì xếp hàng
+static void admit(int amf, Message *m) {
+    int c = admit_class(m);
+    uint32_t ahead = admit_queued(amf, ADMIT_HI) + admit_global_starved[ADMIT_HI];
+    if (c == ADMIT_LO) ahead += admit_queued(amf, ADMIT_LO) + admit_global_starved[ADMIT_LO];
+    if (ahead == 0 && admit_take(amf, 1, sim_now_us()) == 1) {
+        send_req(amf, m);
+        return;
+    }
+    AdmitQueue *q = ADMIT_Q(amf, c);
+    if (q->tail - q->head >= (uint32_t)admit_backlog) {
+        LOG_WRN("gNB: AMF%d backlog full (class %d), shedding UE%d", amf + 1, c, m->ue_id);
+        admit_shed(m, CAUSE_OVERLOAD);
+        return;
+    }
+    q->msg[q->tail % admit_backlog] = *m;
+    q->t_ms[q->tail % admit_backlog] = now_ms();
+    q->tail++;
+    admit_waiting[c]++;
+    admit_stat[c].queued++;
+}
+
+// redirect = 1 khi gửi lại request cũ (reject/deferred), giữ số lần redirect.
+// m được đổi tại chỗ thành NGAP request (cùng wire format) rồi đưa vào batch
+static void forward_ul(Message *m, int redirect) {
+    if (m->msgid != MSG_UE_RRC_CONNECTION_REQUEST || m->ue_id >= (uint32_t)num_ue) return;
+    int i = m->ue_id;
+    if (!redirect) redirects[i] = 0;
+    if (!atomic_load_explicit(&t_first_ul_us, memory_order_relaxed))
+        atomic_store(&t_first_ul_us, sim_now_us());
+
+    // chọn AMF cho UE nếu chưa gán hoặc AMF đã rời
+    int amf = ue_to_amf[i];
+    int fd = amf >= 0 ? atomic_load(&amf_conns[amf].sock_fd) : -1;
+    if (amf >= 0 && fd <= 0 && atomic_load(&amf_conns[amf].in_grace)) {
+        // AMF đang khởi động lại (context còn trong file của nó): giữ UE, gửi khi AMF join lại.
+        // Hàng chờ đầy thì UE backoff rồi gửi lại (request chưa có timer, bỏ im lặng thì UE kẹt)
+        if (n_deferred < RING_CAP) {
+            deferred_amf[n_deferred] = amf;
+            deferred[n_deferred++] = *m;
+        } else {
+            reject_ue(i, CAUSE_OVERLOAD);
+        }
+        return;
+    }
+    if (amf >= 0 && fd <= 0) {
+        pthread_mutex_lock(&amf_lock);
+        lb_release(&lb, amf);
+        pthread_mutex_unlock(&amf_lock);
+        ue_to_amf[i] = amf = -1;
+    }
+    if (amf < 0) {
+        pthread_mutex_lock(&amf_lock);
+        amf = lb_pick(&lb, m->tmsi);
+        pthread_mutex_unlock(&amf_lock);
+        if (amf < 0) {
+            // chưa có AMF / mọi AMF đã đầy: UE backoff rồi gửi lại, không giữ request vô hạn
+            reject_ue(i, CAUSE_OVERLOAD);
+            return;
+        }
+        ue_to_amf[i] = amf;
+    }
+
+    // NGAP gửi AMF: chỉ đổi msgid, các field khác giữ nguyên vị trí
+    m->msgid = MSG_RRC_NGAP_REQ;
+    m->cause = 0;
+    trace_stamp(&m->trace, HOP_GNB_UL);
+    if (!redirect) lat_record_hops(LAT_UL_SHM, &m->trace, HOP_UE_ENQ, HOP_GNB_UL);
+
+    if (atomic_load(&amf_conns[amf].sock_fd) <= 0) {
+        pthread_mutex_lock(&amf_lock);
+        lb_release(&lb, amf);
+        pthread_mutex_unlock(&amf_lock);
+        ue_to_amf[i] = -1;
+        return;
+    }
+    admit(amf, m);
+}
+
+static Message *admit_pop(AdmitQueue *q, int c) {
+    admit_waiting[c]--;
+    return &q->msg[q->head++ % admit_backlog];
+}
+
+/*
+ * Gửi request đang chờ theo token: lớp S-TMSI của mọi AMF trước, rồi tới
+ * attach; AMF đầu tiên xoay vòng mỗi lượt để bucket chung không nghiêng về
+ * một AMF. AMF đang trong grace giữ hàng (chỉ bỏ request quá hạn), AMF đã
+ * rời hẳn thì request được chọn AMF lại. Trả về số request đã gửi.
+ */
+static int drain_admission(long long now_us) {
+    memset(admit_global_starved, 0, sizeof(admit_global_starved));
+    if (admit_waiting[ADMIT_HI] + admit_waiting[ADMIT_LO] == 0) return 0;
+    unsigned long long ms = (unsigned long long)(now_us / 1000);
+    int sent = 0;
+    for (int c = 0; c < ADMIT_CLASSES; c++) {
+        for (int k = 0; k < num_amf; k++) {
+            int a = (admit_rr + k) % num_amf;
+            AdmitQueue *q = ADMIT_Q(a, c);
+            while (q->head != q->tail && ms - q->t_ms[q->head % admit_backlog] > ADMIT_MAX_WAIT_MS)
+                admit_shed(admit_pop(q, c), CAUSE_OVERLOAD);
+            if (q->head == q->tail) continue;
+            if (atomic_load(&amf_conns[a].sock_fd) <= 0) {
+                if (atomic_load(&amf_conns[a].in_grace)) continue;
+                while (q->head != q->tail) {
+                    Message m = *admit_pop(q, c);
+                    // UE đã được failover gỡ khỏi AMF: báo đăng ký lại qua migrate_q, không gửi AMF khác
+                    if (ue_to_amf[m.ue_id] != a) continue;
+                    m.msgid = MSG_UE_RRC_CONNECTION_REQUEST;
+                    forward_ul(&m, 1);
+                }
+                continue;
             }
+            int n = admit_take(a, (int)(q->tail - q->head), now_us);
+            for (int j = 0; j < n; j++) send_req(a, admit_pop(q, c));
+            sent += n;
+            if (q->head != q->tail && tb_avail(&admit_tb, now_us) == 0) admit_global_starved[c] = 1;
         }
     }
-    return best_i;
+    admit_rr = (admit_rr + 1) % num_amf;
+    return sent;
+}
+
+// ms tới khi hàng chờ có thể tiến (token kế tiếp hoặc request cũ nhất hết hạn), -1: hàng rỗng
+static long admit_wait_ms(unsigned long long ms) {
+    long best = -1;
+    for (int a = 0; a < num_amf; a++) {
+        for (int c = 0; c < ADMIT_CLASSES; c++) {
+            AdmitQueue *q = ADMIT_Q(a, c);
+            if (q->head == q->tail) continue;
+            unsigned long long expire = q->t_ms[q->head % admit_backlog] + ADMIT_MAX_WAIT_MS + 1;
+            long w = expire > ms ? (long)(expire - ms) : 0;
+            if (!atomic_load(&amf_conns[a].in_grace)) {
+                long t = tb_wait_ms(&amf_tb[a]), g = tb_wait_ms(&admit_tb);
+                if (g > t) t = g;
+                if (t < w) w = t;
+            }
+            if (best < 0 || w < best) best = w;
+        }
+    }
+    return best;
+}
+
+// AMF reject (echo request): trả slot, chuyển UE sang AMF kế tiếp; quá MAX_REDIRECTS thì reject UE
+static void redirect_ul(Message *rej) {
+    if (rej->ue_id >= (uint32_t)num_ue) return;
+    int i = rej->ue_id;
+    int amf = ue_to_amf[i];
+    unassign_ue(i);
+    if (rej->cause == CAUSE_UE_UNKNOWN) {   // AMF mới không biết S-TMSI: UE đăng ký lại
+        reject_ue(i, CAUSE_UE_UNKNOWN);
+        return;
+    }
+    if (++redirects[i] > MAX_REDIRECTS) {
+        reject_ue(i, rej->cause);
+        return;
+    }
+    LOG_WRN("gNB: AMF%d rejected UE%d, redirecting (attempt %d)", amf + 1, i, redirects[i]);
+    rej->msgid = MSG_UE_RRC_CONNECTION_REQUEST;   // request echo lại, gửi lại tại chỗ
+    rej->cause = 0;
+    forward_ul(rej, 1);
+}
+
+// request không có response: UE backoff rồi gửi lại; attach thì chọn lại AMF
+static void on_req_timeout(TimerNode *t, void *arg) {
+    (void)arg;
+    int i = t->id;
+    uint8_t kind = atomic_exchange(&req_pending[i], 0);
+    if (!kind) return;   // đã có response
+    if (kind & BM_RANDOM_VALUE) unassign_ue(i);
+    reject_ue(i, CAUSE_TIMEOUT);
+}
+
+/*
+ * Failover: AMF chết (hết grace mà không quay lại) thì uplink thread gỡ mọi UE
+ * của nó khỏi ue_to_amf / lb ngay một lượt, rồi báo từng UE đăng ký lại
+ * (reject CAUSE_UE_UNKNOWN) với tốc độ failover_rate. Attach mới đi qua lb
+ * bình thường nên được chia cho các AMF còn sống theo policy, còn token bucket
+ * giữ đợt đăng ký lại không vượt quá tốc độ AMF chịu được. Thời gian phục hồi
+ * ~ grace + số UE / failover_rate, đo trong FailoverStat.
+ */
+static TokenBucket failover_tb;
+static int *migrate_q;          // num_ue, hàng UE chờ được báo, uplink thread sở hữu
+static uint32_t migrate_head, migrate_tail;
+static uint8_t *migrate_queued; // UE đang nằm trong migrate_q
+// gen << 16 | AMF + 1 của lần failover UE đang được chuyển, 0: không.
+// Uplink thread đặt trong start_failover, downlink thread lấy ra khi UE đăng ký lại
+static _Atomic uint32_t *migrating;
+
+static void start_failover(int amf) {
+    FailoverStat *f = &failover[amf];
+    int n = 0;
+    // request đang chờ AMF này trong grace: UE được báo một lần qua migrate_q bên dưới
+    int kept = 0;
+    for (int k = 0; k < n_deferred; k++) {
+        if (deferred_amf[k] == amf) continue;
+        deferred_amf[kept] = deferred_amf[k];
+        deferred[kept++] = deferred[k];
+    }
+    n_deferred = kept;
+    // lần mới: UE còn treo từ lần failover trước của AMF này mang gen cũ, bị bỏ qua
+    uint32_t tag = (uint32_t)(uint16_t)(atomic_fetch_add(&f->gen, 1) + 1) << 16 | (amf + 1);
+    atomic_store(&f->done, 0);
+    pthread_mutex_lock(&amf_lock);
+    for (int u = 0; u < num_ue; u++) {
+        if (ue_to_amf[u] != amf) continue;
+        ue_to_amf[u] = -1;
+        lb_release(&lb, amf);
+        atomic_store(&migrating[u], tag);
+        if (!migrate_queued[u]) {
+            migrate_queued[u] = 1;
+            migrate_q[migrate_tail++ % num_ue] = u;
+        }
+        n++;
+    }
+    pthread_mutex_unlock(&amf_lock);
+    f->down_us = atomic_load(&amf_conns[amf].down_us);
+    f->start_us = sim_now_us();
+    atomic_store(&f->done_us, n ? 0 : f->start_us);
+    atomic_store(&f->total, n);   // UE chỉ được báo đăng ký lại sau khi hàm này trả về
+    printf("gNB: AMF%d failed, migrating %d UEs at %s%d UE/s (expect ~%.1f s)\n",
+           amf + 1, n, failover_rate > 0 ? "" : "unlimited ", failover_rate,
+           failover_rate > 0 ? (double)n / failover_rate : 0.0);
+}
+
+// báo UE trong hàng đăng ký lại, theo token bucket; trả về số UE đã báo
+static int drain_migrations(long long now_us) {
+    int want = (int)(migrate_tail - migrate_head);
+    if (want == 0) return 0;
+    int n = tb_take(&failover_tb, now_us, want);
+    for (int k = 0; k < n; k++) {
+        int u = migrate_q[migrate_head++ % num_ue];
+        migrate_queued[u] = 0;
+        atomic_store(&req_pending[u], 0);
+        push_ctl(u, CAUSE_UE_UNKNOWN);
+    }
+    return n;
+}
+
+// UE vừa đăng ký lại (downlink thread): ghi nhận tiến độ failover
+static void migration_done(int uid) {
+    uint32_t tag = atomic_exchange(&migrating[uid], 0);
+    if (!tag) return;
+    int amf = (int)(tag & 0xFFFF) - 1;
+    FailoverStat *f = &failover[amf];
+    if ((tag >> 16) != atomic_load(&f->gen)) return;   // lần failover trước, đã bị thay
+    if (atomic_fetch_add(&f->done, 1) + 1 != atomic_load(&f->total)) return;
+    long long t = sim_now_us();
+    atomic_store(&f->done_us, t);
+    printf("gNB: AMF%d failover done: %d UEs re-registered %.3f s after failover (%.3f s after loss)\n",
+           amf + 1, f->total, (t - f->start_us) / 1e6, (t - f->down_us) / 1e6);
+}
+
+// uplink thread ở đầu vòng lặp không còn giữ fd cũ nào: đóng fd của AMF đã rời
+static void close_left_fds(void) {
+    if (!atomic_load(&n_closing)) return;
+    pthread_mutex_lock(&amf_lock);
+    for (int k = 0; k < n_closing; k++) close(closing_fds[k]);
+    atomic_store(&n_closing, 0);
+    pthread_mutex_unlock(&amf_lock);
 }
 
-// =============== UPLINK THREAD ===============
 void *uplink_thread(void *arg) {
     (void)arg;
+    Message burst[RING_BURST];
+    int epoch = 0;
     while (1) {
-        for (int i = 0; i < NUM_UE; i++) {
-            pthread_mutex_lock(&shm->mutex);
-            if (!shm->ul_ready[i]) {
-                pthread_mutex_unlock(&shm->mutex);
-                continue;
-            }
-            Message m = shm->ul[i];
-            shm->ul_ready[i] = 0;  // clear flag
-            pthread_mutex_unlock(&shm->mutex);
-
-            if (m.msgid != MSG_UE_RRC_CONNECTION_REQUEST) continue;
-
-            // chọn AMF cho UE nếu chưa gán
-            int amf = ue_to_amf[i];
-            if (amf < 0) {
-                amf = pick_amf_wrr();
-                if (amf < 0) continue;
-                ue_to_amf[i] = amf;
-                amf_counts[amf]++;
-            }
+        uint32_t seen = doorbell_seq(&shm->ul_bell);
 
-            // đóng gói NGAP gửi AMF
-            Message ngap = {
-                .msgid  = MSG_RRC_NGAP_REQ,
-                .bitmask= m.bitmask,
-                .ue_id  = i,
-                .tmsi   = m.tmsi,
-                .s_tmsi = m.s_tmsi
-            };
-
-            int fd = amf_conns[amf].sock_fd;
-            if (fd <= 0) {
-                amf_counts[amf]--;
-                ue_to_amf[i] = -1;
-                continue;
-            }
+        close_left_fds();
+        for (int a = 0; a < num_amf; a++)
+            if (atomic_exchange(&amf_conns[a].failed, 0)) start_failover(a);
+        int migrated = drain_migrations(sim_now_us());
+        int admitted = drain_admission(sim_now_us());
 
-            if (sctp_sendmsg(fd, &ngap, sizeof(ngap),
-                             NULL, 0, 0, 0, 0, 0, 0) < 0) {
-                perror("uplink send");
-                amf_counts[amf]--;
-                ue_to_amf[i] = -1;
-                continue;
+        // có AMF mới join -> thử lại các request đang chờ
+        int e = atomic_load(&amf_epoch);
+        if (e != epoch && n_deferred > 0) {
+            int n = n_deferred;
+            Message retry[RING_CAP];
+            int retry_amf[RING_CAP];
+            memcpy(retry, deferred, n * sizeof(Message));
+            memcpy(retry_amf, deferred_amf, n * sizeof(int));
+            n_deferred = 0;
+            for (int k = 0; k < n; k++) {
+                // chỉ gửi lại cho đúng AMF request đã chờ; UE bị chuyển đi thì do migrate_q báo
+                if (ue_to_amf[retry[k].ue_id] != retry_amf[k]) continue;
+                forward_ul(&retry[k], 1);
             }
+        }
+        epoch = e;
+
+        // request bị AMF reject: chuyển sang AMF khác
+        uint32_t r = ring_dequeue_burst(&redirect_q, burst, RING_BURST);
+        for (uint32_t k = 0; k < r; k++) redirect_ul(&burst[k]);
 
-            printf("gNB: Forwarded uplink req from UE%d to AMF%d\n", i, amf + 1);
+        // mỗi shard tối đa một burst mỗi vòng để shard đông không lấn shard khác
+        uint32_t n = 0;
+        for (uint32_t sh = 0; sh < shm->hdr.num_shards; sh++) {
+            uint32_t got = ring_dequeue_burst(&shm->shard[sh].ul, burst, RING_BURST);
+            for (uint32_t k = 0; k < got; k++) forward_ul(&burst[k], 0);
+            n += got;
         }
-        usleep(1000);
+
+        unsigned long long ms = now_ms();
+        tw_advance(&req_wheel, ms, on_req_timeout, NULL);
+        if (n == 0 && r == 0 && migrated == 0 && admitted == 0) {
+            // ring rỗng: gửi hết batch trước khi ngủ
+            for (int a = 0; a < num_amf; a++)
+                for (int st = 0; st < SCTP_STREAMS; st++) flush_ul_batch(a, st);
+            long timeout = tw_next_timeout(&req_wheel, ms);
+            if (migrate_tail != migrate_head) {   // chờ token cho UE kế tiếp
+                long w = tb_wait_ms(&failover_tb);
+                if (timeout < 0 || w < timeout) timeout = w;
+            }
+            long w = admit_wait_ms(ms);   // request chờ token
+            if (w >= 0 && (timeout < 0 || w < timeout)) timeout = w;
+            doorbell_wait(&shm->ul_bell, seen, timeout);
+            continue;
+        }
+
+        long long now = sim_now_us();
+        for (int a = 0; a < num_amf; a++)
+            for (int st = 0; st < SCTP_STREAMS; st++)
+                if (batch_due(UL_BATCH(a, st), now)) flush_ul_batch(a, st);
     }
     return NULL;
 }
 
+// shard có bản tin DL chưa được báo / có ring DL đầy quá hạn, downlink thread sở hữu
+static uint64_t dl_dirty;
+static uint64_t dl_stalled;
+
+// đẩy bản tin vào ring DL của shard, chờ có hạn nếu ring đầy (UE shard chưa kịp đọc)
+static void push_dl_msg(const Message *m) {
+    ShmShard *sh = shm_shard_of(shm, m->ue_id);
+    if (shard_push(sh, &sh->dl, m, &dl_stalled)) dl_dirty |= 1ULL << (sh - shm->shard);
+}
 
 // =============== DOWNLINK THREAD ===============
-void *downlink_thread(void *arg) {
-    (void)arg;
-    fd_set readfds;
+// nhận mọi AMF đang chờ trên listen socket (edge-triggered: accept tới EAGAIN)
+static void accept_amfs(void) {
     while (1) {
-        FD_ZERO(&readfds);
-        int maxfd = -1;
-        for (int i = 0; i < NUM_AMF; i++) {
-            int fd = amf_conns[i].sock_fd;
-            if (fd > 0) {
-                FD_SET(fd, &readfds);
-                if (fd > maxfd) maxfd = fd;
-            }
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("gNB accept");
+            return;
         }
-        if (maxfd < 0) { usleep(1000); continue; }
-
-        if (select(maxfd + 1, &readfds, NULL, NULL, NULL) < 0) continue;
-
-        for (int i = 0; i < NUM_AMF; i++) {
-            int fd = amf_conns[i].sock_fd;
-            if (fd > 0 && FD_ISSET(fd, &readfds)) {
-                Message m;
-                int r = sctp_recvmsg(fd, &m, sizeof(m), NULL, 0, NULL, NULL);
-                if (r <= 0) {
-                    if (r == 0) printf("gNB: AMF%d disconnected\n", i + 1);
-                    close(fd);
-                    amf_conns[i].sock_fd = -1;
-                    continue;
-                }
-		printf("gNB: Received from AMF%d, msgid=0x%x, ue_id=%d, bitmask=0x%x, s_tmsi=0x%llx\n",
-               i + 1, m.msgid, m.ue_id, m.bitmask, (unsigned long long)(m.s_tmsi & 0xFFFFFFFFFF));
-                if (m.msgid == MSG_NGAP_RESP || m.msgid == MSG_NGAP_RRC_PAGING) {
-                    int uid = m.ue_id;
-                    if (uid < 0 || uid >= NUM_UE) {
-                        printf("gNB: Invalid UE ID %d from AMF%d, ignoring\n", uid, i + 1);
-                        continue;
-                    }
-                    pthread_mutex_lock(&shm->mutex);
-		    shm->dl[uid].msgid = (m.msgid == MSG_NGAP_RESP) ? MSG_RRC_UE_CONNECTION_RESPONSE : MSG_RRC_UE_PAGING;
-                    shm->dl[uid].bitmask = m.bitmask;
-                    shm->dl[uid].s_tmsi = m.s_tmsi & 0xFFFFFFFFFF;
-                    shm->dl_ready[uid] = 1;
-                    pthread_mutex_unlock(&shm->mutex);
-                    printf("gNB: Forwarded %s from AMF%d to UE%d (S-TMSI=0x%llx)\n",
-                            (m.msgid == MSG_NGAP_RESP) ? "response" : "paging", i + 1, uid, (unsigned long long)(m.s_tmsi & 0xFFFFFFFFFF));
-               }
+        AmfPeer *p = malloc(sizeof(*p));
+        p->fd = fd;
+        p->amf = -1;
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | EPOLLET, .data.ptr = p };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("gNB epoll_ctl");
+            close(fd);
+            free(p);
+        }
+    }
+}
+
+// AMF gửi init: gán vào bảng AMF
+static int amf_join(AmfPeer *p, const InitMessage *init) {
+    int aid = init->amf_id;
+    pthread_mutex_lock(&amf_lock);
+    if (aid < 0 || aid >= num_amf || atomic_load(&amf_conns[aid].sock_fd) > 0) {
+        pthread_mutex_unlock(&amf_lock);
+        printf("gNB: Invalid/duplicate AMF ID %d, closing\n", aid);
+        return -1;
+    }
+    int n_streams = sctp_streams(p->fd);
+    amf_conns[aid].amf_id = aid;
+    atomic_store(&amf_conns[aid].features, 0);
+    atomic_store(&amf_conns[aid].n_streams, n_streams);
+    atomic_store(&amf_conns[aid].sock_fd, p->fd);   // sau cùng: uplink thấy fd thì thấy cả stream/feature
+    lb_join(&lb, aid, init->capacity, init->capacity);
+    pthread_mutex_unlock(&amf_lock);
+    p->amf = aid;
+    printf("gNB: AMF%d (cap=%d) connected on socket %d, %d streams\n",
+           aid + 1, init->capacity, p->fd, n_streams);
+    if (atomic_exchange(&amf_conns[aid].in_grace, 0))
+        printf("gNB: AMF%d re-associated within grace, keeping its %d UEs\n", aid + 1, lb.count[aid]);
+
+    // đánh thức uplink thread để chuyển các request đang chờ AMF
+    atomic_fetch_add(&amf_epoch, 1);
+    doorbell_ring(&shm->ul_bell);
+    return 0;
+}
+
+// association đóng: gỡ AMF khỏi bảng. UE đã gán giữ nguyên trong rejoin_grace_ms
+// (AMF khởi động lại với context cũ thì không phải cân bằng lại), hết grace thì
+// được chọn lại ở lần UL sau
+static void amf_leave(AmfPeer *p) {
+    if (p->amf >= 0) {
+        AmfConn *c = &amf_conns[p->amf];
+        printf("gNB: AMF%d disconnected, holding its UEs for %d ms\n", p->amf + 1, rejoin_grace_ms);
+        pthread_mutex_lock(&amf_lock);
+        atomic_store(&c->sock_fd, -1);
+        lb_leave(&lb, p->amf);
+        pthread_mutex_unlock(&amf_lock);
+        atomic_store(&c->down_us, sim_now_us());
+        if (rejoin_grace_ms > 0) {
+            c->grace_until = now_ms() + rejoin_grace_ms;
+            atomic_store(&c->in_grace, 1);
+        } else {
+            atomic_store(&c->failed, 1);
+            doorbell_ring(&shm->ul_bell);
+        }
+    }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, p->fd, NULL);
+    if (p->amf < 0) {   // chưa join: uplink thread chưa từng thấy fd này
+        close(p->fd);
+    } else {
+        pthread_mutex_lock(&amf_lock);
+        if (n_closing == n_closing_alloc) {
+            n_closing_alloc = n_closing_alloc ? 2 * n_closing_alloc : 8;
+            closing_fds = realloc(closing_fds, n_closing_alloc * sizeof(int));
+            if (!closing_fds) { perror("gNB realloc"); exit(1); }
+        }
+        closing_fds[atomic_fetch_add(&n_closing, 1)] = p->fd;
+        pthread_mutex_unlock(&amf_lock);
+        doorbell_ring(&shm->ul_bell);
+    }
+    free(p);
+}
+
+// AMF đề nghị feature: chấp nhận phần gNB hỗ trợ và trả lại cho AMF
+static void amf_features(AmfPeer *p, const FeatureMessage *req) {
+    uint32_t features = req->features & GNB_FEATURES;
+    FeatureMessage ack = { .msgid = MSG_FEATURES, .version = WIRE_VERSION, .features = features };
+    atomic_store(&amf_conns[p->amf].features, features);
+    wire_ctl_order(&ack, sizeof(ack));
+    if (amf_send(p->fd, &ack, sizeof(ack), 0) < 0) perror("gNB send features");
+    printf("gNB: AMF%d features=0x%x\n", p->amf + 1, features);
+}
+
+// AMF báo tải: cập nhật capacity/weight trong lb (UE bị reject khi mọi AMF đầy tự gửi lại sau backoff)
+static void amf_load_report(AmfPeer *p, const LoadReport *r) {
+    pthread_mutex_lock(&amf_lock);
+    lb_report(&lb, p->amf, r->load, r->capacity, r->latency_us);
+    pthread_mutex_unlock(&amf_lock);
+    LOG_INF("gNB: AMF%d load report load=%u/%u latency=%uus",
+           p->amf + 1, r->load, r->capacity, r->latency_us);
+}
+
+// AMF i từ chối request vì quá tải: đánh dấu AMF đầy, chuyển request cho uplink thread redirect.
+// Không chờ uplink thread vô hạn: nó có thể đang chờ AMF nhận (amf_send), AMF lại chờ gNB đọc,
+// nên redirect_q đầy quá REDIRECT_RETRIES lần thì trả reject thẳng cho UE qua ring DL.
+// Trả về 1 nếu đã đẩy reject vào ring DL
+static int amf_reject(int i, Message *m) {
+    if (m->cause != CAUSE_UE_UNKNOWN) {   // UE lạ không phải do AMF đầy
+        pthread_mutex_lock(&amf_lock);
+        lb_saturate(&lb, i);
+        pthread_mutex_unlock(&amf_lock);
+    }
+    atomic_store(&req_pending[m->ue_id], 0);
+    for (int k = 0; !ring_enqueue(&redirect_q, m); k++) {
+        doorbell_ring(&shm->ul_bell);
+        if (k == REDIRECT_RETRIES) {
+            m->msgid = MSG_RRC_UE_REJECT;
+            if (m->cause != CAUSE_UE_UNKNOWN) m->cause = CAUSE_OVERLOAD;
+            push_dl_msg(m);
+            LOG_WRN("gNB: Redirect queue full, rejected UE%d (cause=%d), UE will back off", m->ue_id, m->cause);
+            return 1;
+        }
+        sched_yield();
+    }
+    doorbell_ring(&shm->ul_bell);
+    return 0;
+}
+
+// chuyển một bản tin NGAP từ AMF xuống UE; trả về 1 nếu đã đẩy vào ring DL
+static int forward_dl(int i, Message *m) {
+		LOG_DBG("gNB: Received from AMF%d, msgid=0x%x, ue_id=%d, bitmask=0x%x, s_tmsi=0x%llx",
+               i + 1, m->msgid, m->ue_id, m->bitmask, (unsigned long long)(m->s_tmsi & 0xFFFFFFFFFF));
+    if (m->msgid != MSG_NGAP_RESP && m->msgid != MSG_NGAP_RRC_PAGING &&
+        m->msgid != MSG_NGAP_REJECT) return 0;
+
+    if (m->ue_id >= (uint32_t)num_ue) {
+        LOG_WRN("gNB: Invalid UE ID %u from AMF%d, ignoring", m->ue_id, i + 1);
+        return 0;
+    }
+    int uid = m->ue_id;
+    if (m->msgid == MSG_NGAP_REJECT) return amf_reject(i, m);
+    if (m->msgid == MSG_NGAP_RESP) atomic_store(&req_pending[uid], 0);
+    if (m->msgid == MSG_NGAP_RESP && (m->bitmask & BM_RANDOM_VALUE) && !ue_attached[uid]) {
+        ue_attached[uid] = 1;
+        if (atomic_fetch_add(&n_attached, 1) + 1 == num_ue) atomic_store(&t_attached_us, sim_now_us());
+    }
+    if (m->msgid == MSG_NGAP_RESP && (m->bitmask & BM_RANDOM_VALUE) &&
+        atomic_load_explicit(&migrating[uid], memory_order_relaxed)) migration_done(uid);
+    // RRC gửi UE: đổi tại chỗ trong buffer nhận (cùng wire format), không dựng bản tin mới
+    int resp = m->msgid == MSG_NGAP_RESP;
+    m->msgid = resp ? MSG_RRC_UE_CONNECTION_RESPONSE : MSG_RRC_UE_PAGING;
+    m->s_tmsi &= 0xFFFFFFFFFF;
+    trace_stamp(&m->trace, HOP_GNB_DL);
+    lat_record_hops(LAT_AMF_TO_GNB, &m->trace, HOP_AMF_TX, HOP_GNB_DL);
+    push_dl_msg(m);
+    if (resp)
+        LOG_INF("gNB: Forwarded response from AMF%d to UE%d (S-TMSI=0x%llx)", i + 1, uid, (unsigned long long)m->s_tmsi);
+    else
+        LOG_INF("gNB: Forwarded paging from AMF%d to UE%d (S-TMSI=0x%llx)", i + 1, uid, (unsigned long long)m->s_tmsi);
+    return 1;
+}
+
+// paging list từ AMF: dựng lại từng paging và đẩy thẳng vào ring DL của shard trong một lượt,
+// doorbell của shard gom lại cuối lượt epoll như bản tin thường
+static int fan_out_paging(int i, const PagingRecord *recs, int n) {
+    int pushed = 0;
+    for (int k = 0; k < n; k++) {
+        Message m;
+        paging_to_msg(&recs[k], &m);
+        pushed += forward_dl(i, &m);
+    }
+    LOG_DBG("gNB: Paging list of %d from AMF%d fanned out", n, i + 1);
+    return pushed;
+}
+
+// đọc hết bản tin trên association tới EAGAIN; trả về số bản tin đã đẩy vào ring DL
+static int drain_amf(AmfPeer *p) {
+    int pushed = 0;
+    while (1) {
+        union {
+            Message m;
+            InitMessage init;
+            FeatureMessage feat;
+            LoadReport load;
+            BatchFrame frame;
+            PagingFrame pages;
+        } buf;
+        int r = sctp_recvmsg(p->fd, &buf, sizeof(buf), NULL, 0, NULL, NULL);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (r <= 0) {
+            amf_leave(p);
+            break;
+        }
+
+        if (p->amf < 0) {
+            if (!wire_is(&buf, r, MSG_INIT, sizeof(InitMessage))) {
+                printf("gNB: Invalid init from AMF (len=%d, wire version %u), closing\n",
+                       r, r >= 2 ? ((uint8_t *)&buf)[1] : 0);
+                amf_leave(p);
+                break;
+            }
+            wire_ctl_order(&buf.init, sizeof(buf.init));
+            if (amf_join(p, &buf.init) < 0) {
+                amf_leave(p);
+                break;
             }
+            continue;
+        }
+        if (wire_is(&buf, r, MSG_FEATURES, sizeof(FeatureMessage))) {
+            wire_ctl_order(&buf.feat, sizeof(buf.feat));
+            amf_features(p, &buf.feat);
+            continue;
+        }
+        if (wire_is(&buf, r, MSG_LOAD_REPORT, sizeof(LoadReport))) {
+            wire_ctl_order(&buf.load, sizeof(buf.load));
+            amf_load_report(p, &buf.load);
+            continue;
+        }
+
+        PagingRecord *recs;
+        int np = paging_view(&buf, r, &recs);
+        if (np >= 0) {
+            pushed += fan_out_paging(p->amf, recs, np);
+            continue;
+        }
+
+        // một datagram có thể là một Message hoặc một batch
+        Message *msgs;
+        int n = batch_view(&buf, r, &msgs);
+        for (int k = 0; k < n; k++) pushed += forward_dl(p->amf, &msgs[k]);
+    }
+    return pushed;
+}
+
+// AMF hết grace mà chưa quay lại: thả UE của nó cho lb; trả về ms tới lần hết grace kế tiếp (-1: không có)
+static int expire_grace(void) {
+    unsigned long long now = now_ms();
+    long next = -1;
+    int expired = 0;
+    for (int i = 0; i < num_amf; i++) {
+        AmfConn *c = &amf_conns[i];
+        if (!atomic_load(&c->in_grace)) continue;
+        if (now >= c->grace_until) {
+            atomic_store(&c->in_grace, 0);
+            atomic_store(&c->failed, 1);
+            printf("gNB: AMF%d did not come back within %d ms\n", i + 1, rejoin_grace_ms);
+            expired = 1;
+        } else if (next < 0 || (long)(c->grace_until - now) < next) {
+            next = (long)(c->grace_until - now);
+        }
+    }
+    if (expired) {   // uplink thread chuyển UE đi, request đang hoãn chọn AMF mới
+        atomic_fetch_add(&amf_epoch, 1);
+        doorbell_ring(&shm->ul_bell);
+    }
+    return (int)next;
+}
+
+void *downlink_thread(void *arg) {
+    (void)arg;
+    struct epoll_event events[64];
+    while (1) {
+        int n = epoll_wait(epfd, events, 64, expire_grace());
+        if (n < 0) continue;
+
+        for (int k = 0; k < n; k++) {
+            AmfPeer *p = events[k].data.ptr;
+            if (p == NULL) accept_amfs();     // listen socket
+            else drain_amf(p);
         }
+        // đánh thức downlink thread của mỗi shard UE một lần cho cả lượt epoll_wait
+        for (; dl_dirty; dl_dirty &= dl_dirty - 1)
+            doorbell_ring(&shm->shard[__builtin_ctzll(dl_dirty)].dl_bell);
     }
     return NULL;
 }
 
 
 // =============== MAIN ===============
-int main() {
-    srand(time(NULL));
-    init_shm();
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-a num_amf] [-l swrr|least|p2c|chash] [-s seed] [-m monitor_ms] [-o summary.json]\n"
+                    "          [-p listen_port] [-n shm_name] [-r rejoin_grace_ms] [-F failover_ue_per_s]\n"
+                    "          [-R global_req_per_s] [-A amf_req_per_s] [-B admit_backlog]\n", prog);
+    exit(1);
+}
+
+// kết quả cho benchmark: thời gian attach/connect, phân bổ UE theo AMF so với capacity
+static void write_summary(const char *path, long long t_connected_us) {
+    FILE *f = fopen(path, "w");
+    if (!f) { perror("gNB summary"); return; }
+    long long t0 = t_first_ul_us, ta = t_attached_us;
+    double attach_s = ta > t0 ? (ta - t0) / 1e6 : 0;
+    double connect_s = t_connected_us > t0 ? (t_connected_us - t0) / 1e6 : 0;
+    long long cap_sum = 0;
+    for (int i = 0; i < num_amf; i++) cap_sum += lb.capacity[i];
+    fprintf(f, "{\"num_ue\":%d,\"num_amf\":%d,\"lb\":\"%s\",\"attached\":%d,"
+               "\"attach_s\":%.6f,\"attach_per_s\":%.1f,\"connect_s\":%.6f,\"amf\":[",
+            num_ue, num_amf, lb_name, atomic_load(&n_attached), attach_s,
+            attach_s > 0 ? num_ue / attach_s : 0, connect_s);
+    // phân bổ lý tưởng: num_ue chia theo tỉ lệ capacity
+    double err_max = 0, err_sum = 0;
+    for (int i = 0; i < num_amf; i++) {
+        double expect = cap_sum ? (double)num_ue * lb.capacity[i] / cap_sum : 0;
+        double err = (lb.count[i] - expect) * 100.0 / num_ue;
+        if (err < 0) err = -err;
+        if (err > err_max) err_max = err;
+        err_sum += err;
+        fprintf(f, "%s{\"id\":%d,\"count\":%d,\"capacity\":%d,\"expected\":%.1f}",
+                i ? "," : "", i + 1, lb.count[i], lb.capacity[i], expect);
+    }
+    fprintf(f, "],\"dist_err_max_pct\":%.3f,\"dist_err_mean_pct\":%.3f,\"failover\":[",
+            err_max, num_amf ? err_sum / num_amf : 0);
+    // recover_s: từ lúc mất association tới khi UE cuối cùng đăng ký lại ở AMF khác (null: chưa xong)
+    int first = 1;
+    for (int i = 0; i < num_amf; i++) {
+        FailoverStat *fo = &failover[i];
+        if (!fo->start_us) continue;
+        long long done = atomic_load(&fo->done_us);
+        fprintf(f, "%s{\"amf\":%d,\"ues\":%d,\"migrated\":%d,\"recover_s\":",
+                first ? "" : ",", i + 1, fo->total, atomic_load(&fo->done));
+        if (done) fprintf(f, "%.6f}", (done - fo->down_us) / 1e6);
+        else fprintf(f, "null}");
+        first = 0;
+    }
+    fprintf(f, "],\"admission\":{\"rate_global\":%d,\"rate_amf\":%d,\"backlog\":%d,\"classes\":[",
+            admit_rate_global, admit_rate_amf, admit_backlog);
+    for (int c = 0; c < ADMIT_CLASSES; c++)
+        fprintf(f, "%s{\"class\":\"%s\",\"sent\":%ld,\"queued\":%ld,\"shed\":%ld}",
+                c ? "," : "", admit_class_name[c], admit_stat[c].sent, admit_stat[c].queued, admit_stat[c].shed);
+    fprintf(f, "]}}\n");
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    int ch;
+    unsigned int seed = (unsigned int)time(NULL);
+    int monitor_ms = MONITOR_PRINT_MS;
+    const char *summary = NULL;
+    const char *shm_name = SHM_NAME;
+    int port = GNB_LISTEN_PORT;
+    while ((ch = getopt(argc, argv, "a:l:s:m:o:p:n:r:F:R:A:B:")) != -1) {
+        switch (ch) {
+        case 'a': num_amf = atoi(optarg); break;
+        case 'l':
+            if (lb_parse(optarg, &lb_strategy) < 0) usage(argv[0]);
+            lb_name = optarg;
+            break;
+        case 's': seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 'm': monitor_ms = atoi(optarg); break;
+        case 'o': summary = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'n': shm_name = optarg; break;
+        case 'r': rejoin_grace_ms = atoi(optarg); break;
+        case 'F': failover_rate = atoi(optarg); break;
+        case 'R': admit_rate_global = atoi(optarg); break;
+        case 'A': admit_rate_amf = atoi(optarg); break;
+        case 'B': admit_backlog = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (num_amf <= 0 || monitor_ms <= 0 || port <= 0 || port > 65535 || admit_backlog <= 0) usage(argv[0]);
+
+    srand(seed);
+    static char tag[64];
+    shm_tag(tag, sizeof(tag), "gnb", shm_name);
+    lat_install_signals(tag);
+    log_init(tag);
+    shm = shm_attach(shm_name);
+    num_ue = shm->hdr.num_ue;
+    ue_states = shm_states(shm);
+    printf("gNB: %d UEs in %u shard(s) (shm %s), port %d, up to %d AMFs, sweep %s\n",
+           num_ue, shm->hdr.num_shards, shm_name, port, num_amf, sweep_level_name());
 
-    for (int i = 0; i < NUM_AMF; i++) {
-        amf_current_weight[i] = 0;
-        amf_counts[i] = 0;
+    amf_conns = xcalloc(num_amf, sizeof(AmfConn));
+    lb_init(&lb, num_amf, lb_strategy, seed);
+    ul_batch = xcalloc((size_t)num_amf * SCTP_STREAMS, sizeof(MsgBatch));
+    ue_to_amf = xcalloc(num_ue, sizeof(int));
+    req_timer = xcalloc(num_ue, sizeof(TimerNode));
+    req_pending = xcalloc(num_ue, sizeof(*req_pending));
+    redirects = xcalloc(num_ue, sizeof(uint8_t));
+    ue_attached = xcalloc(num_ue, sizeof(uint8_t));
+    failover = xcalloc(num_amf, sizeof(FailoverStat));
+    migrate_q = xcalloc(num_ue, sizeof(int));
+    migrate_queued = xcalloc(num_ue, sizeof(uint8_t));
+    migrating = xcalloc(num_ue, sizeof(*migrating));
+    // burst 100 ms: đợt báo đầu không dồn cả giây token vào một lúc
+    tb_init(&failover_tb, failover_rate, failover_rate / 10.0, sim_now_us());
+    amf_tb = xcalloc(num_amf, sizeof(TokenBucket));
+    admit_q = xcalloc((size_t)num_amf * ADMIT_CLASSES, sizeof(AdmitQueue));
+    tb_init(&admit_tb, admit_rate_global, admit_rate_global / 10.0, sim_now_us());
+    for (int i = 0; i < num_amf; i++) {
+        tb_init(&amf_tb[i], admit_rate_amf, admit_rate_amf / 10.0, sim_now_us());
+        for (int c = 0; c < ADMIT_CLASSES; c++) {
+            ADMIT_Q(i, c)->msg = xcalloc(admit_backlog, sizeof(Message));
+            ADMIT_Q(i, c)->t_ms = xcalloc(admit_backlog, sizeof(unsigned long long));
+        }
+    }
+    tw_init(&req_wheel, now_ms());
+
+    for (int i = 0; i < num_amf; i++) {
         amf_conns[i].amf_id = -1;  // Init -1
-        amf_conns[i].sock_fd = -1;
+        atomic_init(&amf_conns[i].sock_fd, -1);
+        atomic_init(&amf_conns[i].n_streams, 1);
+    }
+    for (int i = 0; i < num_ue; i++) {
+        ue_to_amf[i] = -1;
+        req_timer[i].id = i;
     }
-    for (int i = 0; i < NUM_UE; i++) ue_to_amf[i] = -1;
 
     // SCTP server
-    int listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_SCTP);
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_SCTP);
     if (listen_fd < 0) { perror("gNB SCTP socket"); exit(1); }
 
     struct sockaddr_in addr = {0};
     addr.sin_family = AF_INET;
-    addr.sin_port = htons(GNB_LISTEN_PORT);
+    addr.sin_port = htons(port);
     addr.sin_addr.s_addr = INADDR_ANY;
 
     int opt = 1;
     setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sctp_set_streams(listen_fd, SCTP_STREAMS);   // association accept được kế thừa
 
     if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
         perror("gNB SCTP bind"); exit(1);
     }
-    if (listen(listen_fd, NUM_AMF) < 0) {
+    if (listen(listen_fd, SOMAXCONN) < 0) {
         perror("gNB SCTP listen"); exit(1);
     }
-    printf("gNB: Listening for AMFs on port %d...\n", GNB_LISTEN_PORT);
-
-    // Accept AMF connections with init message
-    int connected_amf = 0;
-    while (connected_amf < NUM_AMF) {
-        int conn_fd = accept(listen_fd, NULL, NULL);
-        if (conn_fd < 0) {
-            perror("gNB accept");
-            continue;
-        }
 
-        InitMessage init;
-        int r = sctp_recvmsg(conn_fd, &init, sizeof(init), NULL, 0, NULL, NULL);
-        if (r != sizeof(init) || init.msgid != MSG_INIT) {
-            printf("gNB: Invalid init from AMF, closing\n");
-            close(conn_fd);
-            continue;
-        }
-        int aid = init.amf_id;
-        if (aid < 0 || aid >= NUM_AMF || amf_conns[aid].sock_fd > 0) {
-            printf("gNB: Invalid/duplicate AMF ID %d, closing\n", aid);
-            close(conn_fd);
-            continue;
-        }
-        amf_conns[aid].sock_fd = conn_fd;
-        amf_conns[aid].amf_id = aid;
-        amf_capacity[aid] = init.capacity;
-        amf_weight[aid] = init.capacity;
-        amf_current_weight[aid] = 0;
-        amf_counts[aid] = 0;
-        connected_amf++;
-        printf("gNB: AMF%d (cap=%d) connected on socket %d\n", aid + 1, init.capacity, conn_fd);
+    // AMF được accept động trong downlink thread, không chờ đủ num_amf
+    epfd = epoll_create1(0);
+    if (epfd < 0) { perror("gNB epoll_create1"); exit(1); }
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLET, .data.ptr = NULL };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        perror("gNB epoll_ctl listen"); exit(1);
     }
+    printf("gNB: Listening for AMFs on port %d...\n", port);
 
     // Create uplink + downlink threads
     pthread_t tid_ul, tid_dl;
     pthread_create(&tid_ul, NULL, uplink_thread, NULL);
     pthread_create(&tid_dl, NULL, downlink_thread, NULL);
 
-    // Monitor loop
+    // Monitor loop: poll mỗi monitor_ms (benchmark cần độ phân giải cao), in mỗi giây
+    long long last_print = 0;
     while (1) {
-        int connected = 0;
-	int registered = 0;
-        pthread_mutex_lock(&shm->mutex);
-        for (int i = 0; i < NUM_UE; i++) {
-            if (shm->ue_states[i] == UE_CONNECTED) connected++;
-	    if(ue_to_amf[i] >= 0) registered++;
-        }
-        pthread_mutex_unlock(&shm->mutex);
-        printf("gNB: Connected=%d, Registered=%d\n", connected, registered); 
-        for (int i = 0; i < NUM_AMF; i++) {
-            printf("  AMF%d: %d/%d\n", i+1, amf_counts[i], amf_capacity[i]);
+        int connected = (int)sweep_count_u8_eq(ue_states, num_ue, UE_CONNECTED);
+        int registered = (int)sweep_count_nonneg_i32(ue_to_amf, num_ue);
+        long long now = sim_now_us();
+        int done = registered >= num_ue && connected == num_ue;
+        if (done || now - last_print >= MONITOR_PRINT_MS * 1000LL) {
+            last_print = now;
+            printf("gNB: Connected=%d, Registered=%d\n", connected, registered); 
+            for (int i = 0; i < num_amf; i++) {
+                printf("  AMF%d: %d/%d%s\n", i+1, lb.count[i], lb.capacity[i],
+                       atomic_load(&amf_conns[i].sock_fd) > 0 ? "" : " (down)");
+            }
+            if (admit_stat[ADMIT_HI].queued + admit_stat[ADMIT_LO].queued +
+                admit_stat[ADMIT_HI].shed + admit_stat[ADMIT_LO].shed)
+                printf("  Admission: waiting stmsi=%d attach=%d, shed stmsi=%ld attach=%ld\n",
+                       admit_waiting[ADMIT_HI], admit_waiting[ADMIT_LO],
+                       admit_stat[ADMIT_HI].shed, admit_stat[ADMIT_LO].shed);
+            long drops = atomic_load(&dl_drops);
+            if (drops) printf("  DL dropped (UE ring full): %ld\n", drops);
         }
     
-       if (registered >= NUM_UE && connected == NUM_UE) {  
+       if (done) {  
             printf("gNB: All UEs connected, exiting\n");
+            if (summary) write_summary(summary, now);
             break;
         }
-        sleep(1);
+        usleep(monitor_ms * 1000);
     }
 
     // Cleanup
     // Message term = { .msgid = 0xFF };
-    // for (int i = 0; i < NUM_AMF; i++) {
+    // for (int i = 0; i < num_amf; i++) {
     //     if (amf_conns[i].sock_fd > 0) {
     //         sctp_sendmsg(amf_conns[i].sock_fd, &term, sizeof(term), NULL, 0, 0, 0, 0, 0, 0);
     //         close(amf_conns[i].sock_fd);
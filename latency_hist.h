@@ -0,0 +1,175 @@
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "sim_msg.h"
+#include "sim_util.h"
+
+/*
+ * Đo latency end-to-end: Message mang Trace (trace_id, t0 và offset µs từng
+ * hop), mỗi process ghi các khoảng hop vào HDR histogram của riêng từng
+ * thread (một writer, không khóa). Bucket log-linear: 2^LH_SUB_BITS bucket
+ * con mỗi lũy thừa 2, sai số ~3%. lat_dump gộp mọi thread và in
+ * p50/p99/p999; gọi khi exit hoặc khi nhận SIGUSR1 (lat_install_signals).
+ */
+#define LH_SUB_BITS 5
+#define LH_SUB      (1 << LH_SUB_BITS)
+#define LH_BUCKETS  ((32 - LH_SUB_BITS + 1) * LH_SUB)   // giá trị uint32 (µs)
+
+enum {
+    LAT_UL_SHM,          // UE enqueue -> gNB uplink dequeue
+    LAT_GNB_TO_AMF,      // gNB uplink dequeue -> AMF nhận (gồm batch + SCTP)
+    LAT_AMF_PROC,        // AMF nhận -> AMF gửi
+    LAT_AMF_TO_GNB,      // AMF gửi -> gNB downlink
+    LAT_DL_SHM,          // gNB downlink -> UE dequeue
+    LAT_ATTACH,          // attach: UE gửi lần đầu -> UE nhận response
+    LAT_PAGING_CONNECT,  // AMF gửi paging -> UE connected
+    LAT_METRICS
+};
+
+static const char *lat_names[LAT_METRICS] = {
+    "ul_shm", "gnb_to_amf", "amf_proc", "amf_to_gnb", "dl_shm", "attach", "paging_connect"
+};
+
+typedef struct {
+    _Atomic uint64_t count[LH_BUCKETS];
+    _Atomic uint32_t max;
+} LatHist;
+
+typedef struct LatThread {
+    LatHist h[LAT_METRICS];
+    struct LatThread *next;
+} LatThread;
+
+static LatThread *lat_threads;
+static pthread_mutex_t lat_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread LatThread *lat_tls;
+static const char *lat_proc = "sim";
+
+// bắt đầu trace mới tại hop hiện tại
+static inline void trace_start(Trace *t, uint32_t id) {
+    memset(t, 0, sizeof(*t));
+    t->id = id;
+    t->t0_ns = sim_now_ns();
+}
+
+static inline void trace_stamp(Trace *t, int hop) {
+    if (!t->t0_ns) return;   // bản tin không có trace
+    t->hop_us[hop] = (uint32_t)((sim_now_ns() - t->t0_ns) / 1000);
+}
+
+static inline int lh_index(uint32_t v) {
+    if (v < LH_SUB) return v;
+    int mag = 31 - __builtin_clz(v);
+    int shift = mag - LH_SUB_BITS;
+    return (shift + 1) * LH_SUB + (int)((v >> shift) - LH_SUB);
+}
+
+// giá trị nhỏ nhất thuộc bucket idx
+static inline uint64_t lh_value(int idx) {
+    int b = idx / LH_SUB, s = idx % LH_SUB;
+    return b == 0 ? (uint64_t)s : (uint64_t)(LH_SUB + s) << (b - 1);
+}
+
+static inline LatThread *lat_thread(void) {
+    if (!lat_tls) {
+        lat_tls = calloc(1, sizeof(LatThread));
+        if (!lat_tls) { perror("lat calloc"); exit(1); }
+        pthread_mutex_lock(&lat_lock);
+        lat_tls->next = lat_threads;
+        lat_threads = lat_tls;
+        pthread_mutex_unlock(&lat_lock);
+    }
+    return lat_tls;
+}
+
+static inline void lat_record(int metric, uint32_t us) {
+    LatHist *h = &lat_thread()->h[metric];
+    _Atomic uint64_t *c = &h->count[lh_index(us)];
+    // chỉ thread này ghi: load + store thay cho RMW
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1, memory_order_relaxed);
+    if (us > atomic_load_explicit(&h->max, memory_order_relaxed))
+        atomic_store_explicit(&h->max, us, memory_order_relaxed);
+}
+
+// ghi khoảng giữa hai hop của trace
+static inline void lat_record_hops(int metric, const Trace *t, int from, int to) {
+    if (!t->t0_ns || t->hop_us[to] < t->hop_us[from]) return;
+    lat_record(metric, t->hop_us[to] - t->hop_us[from]);
+}
+
+static inline uint64_t lh_percentile(const uint64_t *merged, uint64_t total, double p) {
+    uint64_t want = (uint64_t)(total * p + 0.5), seen = 0;
+    if (want == 0) want = 1;
+    for (int i = 0; i < LH_BUCKETS; i++) {
+        seen += merged[i];
+        if (seen >= want) return lh_value(i + 1) - 1;   // cận trên của bucket
+    }
+    return 0;
+}
+
+static inline void lat_dump(void) {
+    static uint64_t merged[LH_BUCKETS];
+    pthread_mutex_lock(&lat_lock);
+    printf("[lat] %s: metric count p50 p99 p999 max (us)\n", lat_proc);
+    for (int m = 0; m < LAT_METRICS; m++) {
+        uint64_t total = 0;
+        uint32_t max = 0;
+        memset(merged, 0, sizeof(merged));
+        for (LatThread *t = lat_threads; t; t = t->next) {
+            for (int i = 0; i < LH_BUCKETS; i++)
+                merged[i] += atomic_load_explicit(&t->h[m].count[i], memory_order_relaxed);
+            uint32_t mx = atomic_load_explicit(&t->h[m].max, memory_order_relaxed);
+            if (mx > max) max = mx;
+        }
+        for (int i = 0; i < LH_BUCKETS; i++) total += merged[i];
+        if (total == 0) continue;
+        uint64_t p[3] = { lh_percentile(merged, total, 0.50),
+                          lh_percentile(merged, total, 0.99),
+                          lh_percentile(merged, total, 0.999) };
+        for (int k = 0; k < 3; k++) if (p[k] > max) p[k] = max;
+        printf("[lat] %s: %-14s %llu %llu %llu %llu %u\n", lat_proc, lat_names[m],
+               (unsigned long long)total, (unsigned long long)p[0],
+               (unsigned long long)p[1], (unsigned long long)p[2], max);
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&lat_lock);
+}
+
+static void *lat_signal_thread(void *arg) {
+    sigset_t *set = arg;
+    while (1) {
+        int sig;
+        if (sigwait(set, &sig) != 0) continue;
+        if (sig == SIGUSR1) lat_dump();
+        else exit(0);   // SIGINT/SIGTERM: atexit in histogram
+    }
+    return NULL;
+}
+
+// gọi trong main trước khi tạo thread khác: các thread kế thừa signal mask
+static inline void lat_install_signals(const char *proc) {
+    static sigset_t set;
+    lat_proc = proc;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, lat_signal_thread, &set) != 0) {
+        perror("pthread_create lat");
+        exit(1);
+    }
+    pthread_detach(tid);
+    atexit(lat_dump);
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef LOAD_REPORT_H
+#define LOAD_REPORT_H
+
+#include <stdint.h>
+#include "sim_msg.h"
+
+/*
+ * AMF báo tải hiện tại cho gNB (tương tự NGAP AMF Status/Load Information).
+ * Chỉ gửi khi đã thỏa thuận FEAT_LOAD_REPORT qua MSG_FEATURES.
+ * AMF gửi định kỳ mỗi LOAD_REPORT_MS và ngay khi load đổi >= 1/LOAD_REPORT_STEP
+ * capacity hoặc AMF vừa đầy, để gNB ngừng chọn AMF đã bão hòa / chậm.
+ */
+#define LOAD_REPORT_MS    500
+#define LOAD_REPORT_STEP  10
+
+typedef struct {
+    uint8_t msgid;          // MSG_LOAD_REPORT
+    uint8_t version;
+    uint8_t pad[2];
+    uint32_t load;          // số UE đang registered
+    uint32_t capacity;
+    uint32_t latency_us;    // thời gian xử lý một burst request (EWMA, worker chậm nhất)
+} LoadReport;
+
+_Static_assert(sizeof(LoadReport) == 16, "LoadReport wire layout");
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef SIM_LOG_H
+#define SIM_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Logger nhị phân bất đồng bộ cho hot path. Mỗi thread ghi record cố định
+ * (timestamp, id format, tối đa LOG_MAX_ARGS tham số số) vào ring SPSC của
+ * riêng nó: không syscall, không khóa; ring đầy thì bỏ record và đếm drop.
+ * Writer thread gom các ring ra file <proc>.binlog, đọc bằng tool log_decode.
+ * Chuỗi format chỉ ghi vào file một lần mỗi call site (lần gọi đầu tiên).
+ * Tham số chỉ nhận số nguyên / số thực (%d %u %x %llx %f ...), không %s.
+ *
+ * Level: LOG_COMPILE_LEVEL loại bỏ lúc compile, log_level (env SIM_LOG_LEVEL
+ * = error|warn|info|debug hoặc 0..3) lọc lúc chạy.
+ */
+#define LOG_ERROR 0
+#define LOG_WARN  1
+#define LOG_INFO  2
+#define LOG_DEBUG 3
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+
+#define LOG_MAX_ARGS 6
+#define LOG_RING_CAP 16384              // record mỗi thread (1 MB), lũy thừa của 2
+#define LOG_IDLE_US  2000               // writer ngủ khi không có record
+#define LOG_MAGIC    "SIMLOG1"
+
+enum { LOG_KIND_FMT = 1, LOG_KIND_REC = 2, LOG_KIND_DROP = 3 };
+
+typedef struct {
+    uint64_t ts_ns;                     // CLOCK_REALTIME
+    uint32_t id;                        // id format
+    uint16_t tid;                       // thread ghi
+    uint8_t nargs;
+    uint8_t fbits;                      // bit k = 1: args[k] là double
+    int64_t args[LOG_MAX_ARGS];
+} LogRec;                               // 64 byte
+
+typedef struct LogRing {
+    _Alignas(64) _Atomic uint32_t head; // producer (thread ghi log)
+    _Alignas(64) _Atomic uint32_t tail; // consumer (writer)
+    _Atomic uint64_t dropped;
+    uint64_t dropped_reported;          // chỉ writer dùng
+    uint16_t tid;
+    struct LogRing *next;
+    LogRec recs[LOG_RING_CAP];
+} LogRing;
+
+static int log_level = LOG_INFO;
+static FILE *log_file;
+static LogRing *log_rings;
+static _Atomic uint32_t log_next_id;
+static uint16_t log_next_tid;
+static pthread_mutex_t log_reg_lock = PTHREAD_MUTEX_INITIALIZER;    // đăng ký thread / format
+static pthread_mutex_t log_drain_lock = PTHREAD_MUTEX_INITIALIZER;  // một consumer tại một thời điểm
+static __thread LogRing *log_tls;
+
+static inline uint64_t log_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int64_t log_i(int64_t v) { return v; }
+static inline int64_t log_d(double d) { int64_t v; memcpy(&v, &d, sizeof(v)); return v; }
+
+#define LOG_V(x) _Generic((x), float: log_d, double: log_d, default: log_i)(x)
+#define LOG_T(x, k) (_Generic((x), float: 1, double: 1, default: 0) << (k))
+
+#define LOG_NARG(...) LOG_NARG_(_, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_NARG_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define LOG_CAT(a, b) LOG_CAT_(a, b)
+#define LOG_CAT_(a, b) a##b
+
+#define LOG_VALS_0()
+#define LOG_VALS_1(a) LOG_V(a)
+#define LOG_VALS_2(a, b) LOG_V(a), LOG_V(b)
+#define LOG_VALS_3(a, b, c) LOG_V(a), LOG_V(b), LOG_V(c)
+#define LOG_VALS_4(a, b, c, d) LOG_V(a), LOG_V(b), LOG_V(c), LOG_V(d)
+#define LOG_VALS_5(a, b, c, d, e) LOG_V(a), LOG_V(b), LOG_V(c), LOG_V(d), LOG_V(e)
+#define LOG_VALS_6(a, b, c, d, e, f) LOG_V(a), LOG_V(b), LOG_V(c), LOG_V(d), LOG_V(e), LOG_V(f)
+
+#define LOG_TYPES_0() 0
+#define LOG_TYPES_1(a) LOG_T(a, 0)
+#define LOG_TYPES_2(a, b) LOG_T(a, 0) | LOG_T(b, 1)
+#define LOG_TYPES_3(a, b, c) LOG_T(a, 0) | LOG_T(b, 1) | LOG_T(c, 2)
+#define LOG_TYPES_4(a, b, c, d) LOG_T(a, 0) | LOG_T(b, 1) | LOG_T(c, 2) | LOG_T(d, 3)
+#define LOG_TYPES_5(a, b, c, d, e) LOG_T(a, 0) | LOG_T(b, 1) | LOG_T(c, 2) | LOG_T(d, 3) | LOG_T(e, 4)
+#define LOG_TYPES_6(a, b, c, d, e, f) LOG_T(a, 0) | LOG_T(b, 1) | LOG_T(c, 2) | LOG_T(d, 3) | LOG_T(e, 4) | LOG_T(f, 5)
+
+// ghi định nghĩa format vào file, trả về id (call site gọi một lần)
+static inline uint32_t log_register(_Atomic uint32_t *site, int level, const char *fmt) {
+    pthread_mutex_lock(&log_reg_lock);
+    uint32_t id = atomic_load(site);
+    if (!id) {
+        id = atomic_fetch_add(&log_next_id, 1) + 1;
+        if (log_file) {
+            uint32_t hdr[4] = { LOG_KIND_FMT, id, (uint32_t)level, (uint32_t)strlen(fmt) };
+            pthread_mutex_lock(&log_drain_lock);
+            fwrite(hdr, sizeof(hdr), 1, log_file);
+            fwrite(fmt, 1, hdr[3], log_file);
+            pthread_mutex_unlock(&log_drain_lock);
+        }
+        atomic_store_explicit(site, id, memory_order_release);
+    }
+    pthread_mutex_unlock(&log_reg_lock);
+    return id;
+}
+
+static inline LogRing *log_ring(void) {
+    if (!log_tls) {
+        LogRing *r = aligned_alloc(64, sizeof(LogRing));
+        if (!r) { perror("log ring"); exit(1); }
+        memset(r, 0, sizeof(*r));
+        pthread_mutex_lock(&log_reg_lock);
+        r->tid = log_next_tid++;
+        r->next = log_rings;
+        log_rings = r;
+        pthread_mutex_unlock(&log_reg_lock);
+        log_tls = r;
+    }
+    return log_tls;
+}
+
+static inline void log_push(uint32_t id, int nargs, int fbits, const int64_t *args) {
+    LogRing *r = log_ring();
+    uint32_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (h - atomic_load_explicit(&r->tail, memory_order_acquire) >= LOG_RING_CAP) {
+        atomic_store_explicit(&r->dropped,
+                              atomic_load_explicit(&r->dropped, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+        return;
+    }
+    LogRec *rec = &r->recs[h & (LOG_RING_CAP - 1)];
+    rec->ts_ns = log_now_ns();
+    rec->id = id;
+    rec->tid = r->tid;
+    rec->nargs = (uint8_t)nargs;
+    rec->fbits = (uint8_t)fbits;
+    memcpy(rec->args, args, nargs * sizeof(int64_t));
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+#define LOG_AT(lvl, fmt, ...) do {                                               \
+    if (0) printf(fmt, ##__VA_ARGS__);   /* chỉ để compiler kiểm tra format */  \
+    if ((lvl) <= LOG_COMPILE_LEVEL && (lvl) <= log_level) {                      \
+        static _Atomic uint32_t log_site_;                                       \
+        uint32_t id_ = atomic_load_explicit(&log_site_, memory_order_acquire);   \
+        if (!id_) id_ = log_register(&log_site_, (lvl), fmt);                    \
+        int64_t args_[LOG_MAX_ARGS + 1] = { 0,                                   \
+            LOG_CAT(LOG_VALS_, LOG_NARG(__VA_ARGS__))(__VA_ARGS__) };            \
+        log_push(id_, LOG_NARG(__VA_ARGS__),                                     \
+                 LOG_CAT(LOG_TYPES_, LOG_NARG(__VA_ARGS__))(__VA_ARGS__), args_ + 1); \
+    }                                                                            \
+} while (0)
+
+#define LOG_ERR(fmt, ...)  LOG_AT(LOG_ERROR, fmt, ##__VA_ARGS__)
+#define LOG_WRN(fmt, ...)  LOG_AT(LOG_WARN, fmt, ##__VA_ARGS__)
+#define LOG_INF(fmt, ...)  LOG_AT(LOG_INFO, fmt, ##__VA_ARGS__)
+#define LOG_DBG(fmt, ...)  LOG_AT(LOG_DEBUG, fmt, ##__VA_ARGS__)
+
+// writer: chép record của mọi ring ra file; trả về số record đã chép
+static inline int log_drain(void) {
+    int n = 0;
+    // thứ tự khóa giống log_register: reg rồi drain, không giữ đồng thời
+    pthread_mutex_lock(&log_reg_lock);
+    LogRing *rings = log_rings;
+    pthread_mutex_unlock(&log_reg_lock);
+    pthread_mutex_lock(&log_drain_lock);
+    for (LogRing *r = rings; r; r = r->next) {
+        uint32_t t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        uint32_t h = atomic_load_explicit(&r->head, memory_order_acquire);
+        for (; t != h; t++, n++) {
+            uint32_t kind = LOG_KIND_REC;
+            fwrite(&kind, sizeof(kind), 1, log_file);
+            fwrite(&r->recs[t & (LOG_RING_CAP - 1)], sizeof(LogRec), 1, log_file);
+        }
+        atomic_store_explicit(&r->tail, t, memory_order_release);
+        uint64_t d = atomic_load_explicit(&r->dropped, memory_order_relaxed);
+        if (d != r->dropped_reported) {
+            uint32_t hdr[2] = { LOG_KIND_DROP, r->tid };
+            uint64_t lost = d - r->dropped_reported;
+            fwrite(hdr, sizeof(hdr), 1, log_file);
+            fwrite(&lost, sizeof(lost), 1, log_file);
+            r->dropped_reported = d;
+        }
+    }
+    if (n == 0) fflush(log_file);
+    pthread_mutex_unlock(&log_drain_lock);
+    return n;
+}
+
+static void *log_writer(void *arg) {
+    (void)arg;
+    struct timespec idle = { 0, LOG_IDLE_US * 1000L };
+    while (1)
+        if (log_drain() == 0) nanosleep(&idle, NULL);
+    return NULL;
+}
+
+static void log_flush(void) {
+    if (log_file) log_drain();
+}
+
+static inline int log_parse_level(const char *s) {
+    static const char *names[] = { "error", "warn", "info", "debug" };
+    for (int i = 0; i < 4; i++)
+        if (strcmp(s, names[i]) == 0) return i;
+    return atoi(s);
+}
+
+// mở <proc>.binlog và chạy writer thread; gọi trong main trước khi tạo thread khác
+static inline void log_init(const char *proc) {
+    const char *lv = getenv("SIM_LOG_LEVEL");
+    if (lv) log_level = log_parse_level(lv);
+    char path[256];
+    snprintf(path, sizeof(path), "%s.binlog", proc);
+    log_file = fopen(path, "wb");
+    if (!log_file) { perror("log fopen"); exit(1); }
+    char hdr[24] = LOG_MAGIC;
+    memcpy(hdr + 8, proc, strnlen(proc, 15));   // tên dài bị cắt, hdr còn lại là 0
+    fwrite(hdr, sizeof(hdr), 1, log_file);
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, log_writer, NULL) != 0) {
+        perror("pthread_create log");
+        exit(1);
+    }
+    pthread_detach(tid);
+    atexit(log_flush);
+}
+
+#endif
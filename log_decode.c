@@ -0,0 +1,137 @@
+// Đọc file .binlog do log.h ghi ra và in dạng text
+// usage: log_decode <file.binlog> [...]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "log.h"
+
+static const char *level_names[] = { "ERROR", "WARN", "INFO", "DEBUG" };
+
+typedef struct {
+    char *fmt;
+    int level;
+} FmtDef;
+
+static FmtDef *fmts;
+static uint32_t n_fmts;
+
+static void add_fmt(uint32_t id, int level, char *fmt) {
+    if (id >= n_fmts) {
+        uint32_t n = id * 2 + 16;
+        fmts = realloc(fmts, n * sizeof(FmtDef));
+        if (!fmts) { perror("realloc"); exit(1); }
+        memset(fmts + n_fmts, 0, (n - n_fmts) * sizeof(FmtDef));
+        n_fmts = n;
+    }
+    fmts[id].fmt = fmt;
+    fmts[id].level = level;
+}
+
+// in một record: từng conversion trong format lấy một tham số, ép kiểu theo length modifier
+static void print_rec(const char *fmt, const LogRec *r) {
+    int k = 0;
+    for (const char *p = fmt; *p; p++) {
+        if (*p != '%') { putchar(*p); continue; }
+        if (p[1] == '%') { putchar('%'); p++; continue; }
+        char spec[32];
+        int len = 0;
+        spec[len++] = *p++;
+        while (*p && strchr("-+ #0123456789.hlLqjzt", *p) && len < 30) spec[len++] = *p++;
+        if (!*p) break;
+        char conv = *p;
+        spec[len++] = conv;
+        spec[len] = 0;
+        if (k >= r->nargs) { fputs(spec, stdout); continue; }
+        int64_t v = r->args[k];
+        int is_double = (r->fbits >> k) & 1;
+        k++;
+        int ll = strstr(spec, "ll") != NULL, l = !ll && strchr(spec, 'l') != NULL;
+        switch (conv) {
+        case 'd': case 'i':
+            if (ll) printf(spec, (long long)v);
+            else if (l) printf(spec, (long)v);
+            else printf(spec, (int)v);
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            if (ll) printf(spec, (unsigned long long)v);
+            else if (l) printf(spec, (unsigned long)v);
+            else printf(spec, (unsigned int)v);
+            break;
+        case 'c':
+            printf(spec, (int)v);
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+            double d;
+            if (is_double) memcpy(&d, &v, sizeof(d));
+            else d = (double)v;
+            printf(spec, d);
+            break;
+        }
+        default:
+            printf("<%%%c?>", conv);   // %s/%p không hỗ trợ
+            break;
+        }
+    }
+}
+
+static int decode(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) { perror(path); return 1; }
+    char hdr[24];
+    if (fread(hdr, sizeof(hdr), 1, f) != 1 || strcmp(hdr, LOG_MAGIC) != 0) {
+        fprintf(stderr, "%s: not a binlog file\n", path);
+        fclose(f);
+        return 1;
+    }
+    char proc[16];
+    memcpy(proc, hdr + 8, 15);
+    proc[15] = 0;
+
+    uint32_t kind;
+    while (fread(&kind, sizeof(kind), 1, f) == 1) {
+        if (kind == LOG_KIND_FMT) {
+            uint32_t def[3];   // id, level, len
+            if (fread(def, sizeof(def), 1, f) != 1) break;
+            char *fmt = malloc(def[2] + 1);
+            if (!fmt || fread(fmt, 1, def[2], f) != def[2]) break;
+            fmt[def[2]] = 0;
+            add_fmt(def[0], (int)def[1], fmt);
+        } else if (kind == LOG_KIND_REC) {
+            LogRec r;
+            if (fread(&r, sizeof(r), 1, f) != 1) break;
+            time_t sec = r.ts_ns / 1000000000ULL;
+            struct tm tm_info;
+            char tbuf[32];
+            localtime_r(&sec, &tm_info);
+            strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", &tm_info);
+            const FmtDef *d = r.id < n_fmts ? &fmts[r.id] : NULL;
+            printf("%s.%06llu %s/%u %-5s ", tbuf, (unsigned long long)(r.ts_ns % 1000000000ULL) / 1000,
+                   proc, r.tid, d && d->fmt ? level_names[d->level & 3] : "?");
+            if (d && d->fmt) print_rec(d->fmt, &r);
+            else printf("<unknown format %u>", r.id);
+            putchar('\n');
+        } else if (kind == LOG_KIND_DROP) {
+            uint32_t tid;
+            uint64_t lost;
+            if (fread(&tid, sizeof(tid), 1, f) != 1 || fread(&lost, sizeof(lost), 1, f) != 1) break;
+            printf("-- %s/%u dropped %llu records (ring full)\n", proc, tid, (unsigned long long)lost);
+        } else {
+            fprintf(stderr, "%s: corrupt record kind %u\n", path, kind);
+            break;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file.binlog> [...]\n", argv[0]);
+        return 1;
+    }
+    int rc = 0;
+    for (int i = 1; i < argc; i++) rc |= decode(argv[i]);
+    return rc;
+}
@@ -0,0 +1,195 @@
+#ifndef NGAP_BATCH_H
+#define NGAP_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "sim_msg.h"
+#include "sim_util.h"
+
+/*
+ * Gom nhiều Message gửi tới cùng một association vào một SCTP datagram.
+ * Chỉ dùng khi hai bên đã thỏa thuận FEAT_BATCH: sau InitMessage, AMF gửi
+ * MSG_FEATURES, gNB trả lại MSG_FEATURES với các feature được chấp nhận.
+ * Peer cũ không gửi/không trả MSG_FEATURES nên vẫn chạy 1 Message/datagram.
+ */
+#define BATCH_MAX       64     // số Message tối đa mỗi datagram
+#define BATCH_FLUSH_US  200    // batch không được giữ lâu hơn
+#define PAGING_MAX      128    // số bản ghi paging tối đa mỗi datagram (cùng cỡ BatchFrame)
+
+typedef struct {
+    uint8_t msgid;      // MSG_FEATURES
+    uint8_t version;
+    uint8_t pad[2];
+    uint32_t features;
+} FeatureMessage;
+
+typedef struct {
+    uint8_t msgid;      // MSG_NGAP_BATCH
+    uint8_t version;
+    uint16_t count;
+    uint32_t reserved;  // giữ Message phía sau align 8 byte
+} BatchHeader;
+
+_Static_assert(sizeof(FeatureMessage) == 8 && sizeof(BatchHeader) == 8, "batch wire layout");
+
+// datagram batch đúng như trên dây: header + count Message liền nhau
+typedef struct {
+    BatchHeader hdr;
+    Message msgs[BATCH_MAX];
+} BatchFrame;
+
+typedef struct {
+    int count;
+    long long first_us;     // lúc Message đầu tiên vào batch
+    BatchFrame frame;
+} MsgBatch;
+
+/*
+ * Paging list (FEAT_PAGING_LIST): các paging đến hạn cùng tick của một
+ * association đi chung một datagram. Paging chỉ cần ue_id, S-TMSI và trace
+ * nên mỗi bản ghi 32 byte thay vì một Message 64 byte; gNB dựng lại Message
+ * paging từ bản ghi (paging_to_msg) khi đẩy xuống ring DL.
+ */
+typedef struct {
+    uint32_t ue_id;
+    uint32_t trace_id;
+    uint64_t s_tmsi;
+    uint64_t t0_ns;         // gốc trace paging -> connect
+    uint32_t amf_tx_us;     // hop HOP_AMF_TX
+    uint32_t reserved;
+} PagingRecord;
+
+_Static_assert(sizeof(PagingRecord) == 32 && offsetof(PagingRecord, s_tmsi) == 8 &&
+               offsetof(PagingRecord, t0_ns) == 16, "PagingRecord wire layout");
+
+typedef struct {
+    BatchHeader hdr;        // msgid = MSG_NGAP_PAGING_LIST
+    PagingRecord recs[PAGING_MAX];
+} PagingFrame;
+
+typedef struct {
+    int count;
+    PagingFrame frame;
+} PagingList;
+
+typedef int (*BatchSendFn)(int fd, const void *buf, size_t len, uint16_t stream);
+
+// thêm Message vào batch, trả về 1 nếu batch đã đầy (cần flush)
+static inline int batch_add(MsgBatch *b, const Message *m) {
+    if (b->count == 0) b->first_us = sim_now_us();
+    b->frame.msgs[b->count++] = *m;
+    return b->count == BATCH_MAX;
+}
+
+static inline int batch_due(const MsgBatch *b, long long now_us) {
+    return b->count > 0 && now_us - b->first_us >= BATCH_FLUSH_US;
+}
+
+// gửi batch trên stream: một datagram nếu peer hỗ trợ FEAT_BATCH, ngược lại từng Message.
+// Message trong batch được đổi sang byte order wire tại chỗ (batch bị bỏ sau khi gửi)
+static inline int batch_flush(MsgBatch *b, int fd, uint32_t features, uint16_t stream,
+                              BatchSendFn send) {
+    int n = b->count, r = 0;
+    b->count = 0;
+    if (n == 0) return 0;
+    for (int i = 0; i < n; i++) msg_wire_order(&b->frame.msgs[i]);
+    if (n == 1 || !(features & FEAT_BATCH)) {
+        for (int i = 0; i < n && r >= 0; i++)
+            r = send(fd, &b->frame.msgs[i], sizeof(Message), stream);
+        return r < 0 ? -1 : n;
+    }
+    b->frame.hdr.msgid = MSG_NGAP_BATCH;
+    b->frame.hdr.version = WIRE_VERSION;
+    b->frame.hdr.count = wire16(n);
+    b->frame.hdr.reserved = 0;
+    r = send(fd, &b->frame, sizeof(BatchHeader) + n * sizeof(Message), stream);
+    return r < 0 ? -1 : n;
+}
+
+// tách datagram nhận được thành dãy Message, trỏ thẳng vào buffer (không copy);
+// Message được đổi sang byte order host tại chỗ nên người nhận sửa/chuyển tiếp luôn được.
+// Bản tin khác WIRE_VERSION bị bỏ (trả về 0)
+static inline int batch_view(void *buf, int len, Message **msgs) {
+    BatchHeader *h = (BatchHeader *)buf;
+    int n;
+    if (len >= (int)sizeof(BatchHeader) && h->msgid == MSG_NGAP_BATCH) {
+        n = wire16(h->count);
+        if (h->version != WIRE_VERSION || n > BATCH_MAX ||
+            len < (int)(sizeof(BatchHeader) + n * sizeof(Message))) return 0;
+        *msgs = ((BatchFrame *)buf)->msgs;
+    } else if (len == (int)sizeof(Message) && ((Message *)buf)->version == WIRE_VERSION) {
+        n = 1;
+        *msgs = (Message *)buf;
+    } else {
+        return 0;
+    }
+    for (int i = 0; i < n; i++) msg_wire_order(&(*msgs)[i]);
+    return n;
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static inline void paging_wire_order(PagingRecord *r) {
+    r->ue_id = __builtin_bswap32(r->ue_id);
+    r->trace_id = __builtin_bswap32(r->trace_id);
+    r->s_tmsi = __builtin_bswap64(r->s_tmsi);
+    r->t0_ns = __builtin_bswap64(r->t0_ns);
+    r->amf_tx_us = __builtin_bswap32(r->amf_tx_us);
+}
+#else
+static inline void paging_wire_order(PagingRecord *r) { (void)r; }
+#endif
+
+// thêm paging (Message MSG_NGAP_RRC_PAGING) vào list, trả về 1 nếu list đã đầy (cần flush)
+static inline int paging_add(PagingList *p, const Message *m) {
+    PagingRecord *r = &p->frame.recs[p->count++];
+    r->ue_id = m->ue_id;
+    r->trace_id = m->trace.id;
+    r->s_tmsi = m->s_tmsi;
+    r->t0_ns = m->trace.t0_ns;
+    r->amf_tx_us = m->trace.hop_us[HOP_AMF_TX];
+    r->reserved = 0;
+    return p->count == PAGING_MAX;
+}
+
+// gửi cả list trong một datagram; trả về số paging đã gửi, -1 nếu lỗi
+static inline int paging_flush(PagingList *p, int fd, uint16_t stream, BatchSendFn send) {
+    int n = p->count;
+    p->count = 0;
+    if (n == 0) return 0;
+    for (int i = 0; i < n; i++) paging_wire_order(&p->frame.recs[i]);
+    p->frame.hdr.msgid = MSG_NGAP_PAGING_LIST;
+    p->frame.hdr.version = WIRE_VERSION;
+    p->frame.hdr.count = wire16(n);
+    p->frame.hdr.reserved = 0;
+    int r = send(fd, &p->frame, sizeof(BatchHeader) + n * sizeof(PagingRecord), stream);
+    return r < 0 ? -1 : n;
+}
+
+// datagram là paging list: trỏ recs vào buffer, đổi byte order tại chỗ, trả về số bản ghi
+// (0 nếu list hỏng / khác version); -1 nếu không phải paging list
+static inline int paging_view(void *buf, int len, PagingRecord **recs) {
+    BatchHeader *h = (BatchHeader *)buf;
+    if (len < (int)sizeof(BatchHeader) || h->msgid != MSG_NGAP_PAGING_LIST) return -1;
+    int n = wire16(h->count);
+    if (h->version != WIRE_VERSION || n > PAGING_MAX ||
+        len < (int)(sizeof(BatchHeader) + n * sizeof(PagingRecord))) return 0;
+    *recs = ((PagingFrame *)buf)->recs;
+    for (int i = 0; i < n; i++) paging_wire_order(&(*recs)[i]);
+    return n;
+}
+
+// dựng lại Message paging như AMF gửi khi không có FEAT_PAGING_LIST
+static inline void paging_to_msg(const PagingRecord *r, Message *m) {
+    memset(m, 0, sizeof(*m));
+    m->msgid = MSG_NGAP_RRC_PAGING;
+    m->version = WIRE_VERSION;
+    m->bitmask = BM_5G_STMSI;
+    m->ue_id = r->ue_id;
+    m->s_tmsi = r->s_tmsi;
+    m->trace.id = r->trace_id;
+    m->trace.t0_ns = r->t0_ns;
+    m->trace.hop_us[HOP_AMF_TX] = r->amf_tx_us;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef SCTP_STREAM_H
+#define SCTP_STREAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <netinet/sctp.h>
+
+/*
+ * Multi-stream SCTP: mỗi association mở tối đa SCTP_STREAMS stream,
+ * bản tin của một UE luôn đi trên stream ue_id % số stream đã thỏa thuận
+ * nên thứ tự theo từng UE được giữ mà UE này không chặn UE khác.
+ */
+#define SCTP_STREAMS 8
+
+// đặt số stream đề nghị; gọi trước listen()/connect()
+static inline int sctp_set_streams(int fd, int n) {
+    struct sctp_initmsg im;
+    memset(&im, 0, sizeof(im));
+    im.sinit_num_ostreams = n;
+    im.sinit_max_instreams = n;
+    if (setsockopt(fd, IPPROTO_SCTP, SCTP_INITMSG, &im, sizeof(im)) < 0) {
+        perror("setsockopt SCTP_INITMSG");
+        return -1;
+    }
+    return 0;
+}
+
+// số stream dùng được theo cả hai chiều sau khi association đã lập
+static inline int sctp_streams(int fd) {
+    struct sctp_status st;
+    socklen_t len = sizeof(st);
+    memset(&st, 0, sizeof(st));
+    if (getsockopt(fd, IPPROTO_SCTP, SCTP_STATUS, &st, &len) < 0) return 1;
+    int n = st.sstat_outstrms < st.sstat_instrms ? st.sstat_outstrms : st.sstat_instrms;
+    if (n > SCTP_STREAMS) n = SCTP_STREAMS;
+    return n > 0 ? n : 1;
+}
+
+static inline uint16_t ue_stream(uint32_t ue_id, int n_streams) {
+    return (uint16_t)(ue_id % n_streams);
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "sim_msg.h"
+
+#define CACHE_LINE 64
+#define RING_CAP   1024            // phải là lũy thừa của 2
+#define RING_MASK  (RING_CAP - 1)
+#define RING_BURST 64              // số bản tin tối đa mỗi lần enqueue/dequeue
+
+/*
+ * Ring SPSC lock-free cho Message, đặt trong shared memory.
+ * head do consumer ghi, tail do producer ghi; mỗi index nằm trên
+ * một cache line riêng kèm bản cache index của phía bên kia.
+ * Ring zero-init (memset 0) là ring rỗng hợp lệ.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE) _Atomic uint32_t head;
+    uint32_t tail_cache;    // consumer cache tail
+    _Alignas(CACHE_LINE) _Atomic uint32_t tail;
+    uint32_t head_cache;    // producer cache head
+    _Alignas(CACHE_LINE) Message slots[RING_CAP];
+} MsgRing;
+
+// producer: đẩy tối đa n bản tin, trả về số bản tin đã đẩy
+static inline uint32_t ring_enqueue_burst(MsgRing *r, const Message *msgs, uint32_t n) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint32_t space = RING_CAP - (tail - r->head_cache);
+    if (space < n) {
+        r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+        space = RING_CAP - (tail - r->head_cache);
+    }
+    if (n > space) n = space;
+    for (uint32_t i = 0; i < n; i++)
+        r->slots[(tail + i) & RING_MASK] = msgs[i];
+    atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+    return n;
+}
+
+// consumer: lấy tối đa max bản tin, trả về số bản tin đã lấy
+static inline uint32_t ring_dequeue_burst(MsgRing *r, Message *out, uint32_t max) {
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint32_t avail = r->tail_cache - head;
+    if (avail < max) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        avail = r->tail_cache - head;
+    }
+    if (max > avail) max = avail;
+    for (uint32_t i = 0; i < max; i++)
+        out[i] = r->slots[(head + i) & RING_MASK];
+    atomic_store_explicit(&r->head, head + max, memory_order_release);
+    return max;
+}
+
+static inline int ring_enqueue(MsgRing *r, const Message *m) {
+    return ring_enqueue_burst(r, m, 1) == 1;
+}
+
+static inline int ring_dequeue(MsgRing *r, Message *out) {
+    return ring_dequeue_burst(r, out, 1) == 1;
+}
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef SIM_MSG_H
+#define SIM_MSG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Wire format dùng chung cho shm (UE <-> gNB) và SCTP (gNB <-> AMF):
+ * - mọi bản tin bắt đầu bằng msgid (byte 0) và WIRE_VERSION (byte 1);
+ * - struct không có padding ngầm: mọi field nằm ở offset cố định, chỗ trống
+ *   là field pad/reserved tường minh (kiểm bằng _Static_assert bên dưới),
+ *   nên struct chính là layout trên dây, đọc/ghi tại chỗ trong buffer nhận;
+ * - số nhiều byte là little-endian. Máy little-endian dùng struct trực tiếp;
+ *   máy big-endian đổi byte order tại chỗ ở biên SCTP (msg_wire_order,
+ *   wire_ctl_order). Shm chỉ nối process cùng máy nên không cần đổi.
+ * Bản tin điều khiển (init, features, load report) là header 4 byte + các
+ * field 32 bit. Nhận bản tin: kiểm msgid, version và độ dài bằng wire_is.
+ */
+#define WIRE_VERSION 1
+
+#define MSG_UE_RRC_CONNECTION_REQUEST 0x10
+#define MSG_RRC_UE_CONNECTION_RESPONSE 0x11
+#define MSG_RRC_NGAP_REQ              0x12
+#define MSG_NGAP_RESP                 0x13
+#define MSG_NGAP_RRC_PAGING           0x14
+#define MSG_RRC_UE_PAGING             0x15
+#define MSG_NGAP_REJECT               0x16   // AMF -> gNB: từ chối request, echo lại request
+#define MSG_RRC_UE_REJECT             0x17   // gNB -> UE: UE backoff rồi gửi lại
+
+// bản tin điều khiển / khung SCTP gNB <-> AMF; msgid của mọi loại bản tin nằm ở đây để không trùng
+#define MSG_INIT                      0x09
+#define MSG_FEATURES                  0x0A   // ngap_batch.h
+#define MSG_NGAP_BATCH                0x0B   // ngap_batch.h
+#define MSG_LOAD_REPORT               0x0C   // load_report.h
+#define MSG_NGAP_PAGING_LIST          0x0D   // ngap_batch.h
+
+// feature thỏa thuận qua MSG_FEATURES (bit)
+#define FEAT_BATCH       0x01
+#define FEAT_LOAD_REPORT 0x02
+#define FEAT_PAGING_LIST 0x04
+
+#define BM_RANDOM_VALUE 0x01
+#define BM_5G_STMSI     0x02
+
+// cause trong bản tin reject
+#define CAUSE_OVERLOAD  1
+#define CAUSE_TIMEOUT   2
+#define CAUSE_UE_UNKNOWN 3  // AMF không còn context của UE (AMF chết / S-TMSI lạ): UE đăng ký lại từ đầu
+
+// các hop của một request/response, offset µs từ t0 (gốc trace)
+enum {
+    HOP_UE_ENQ,     // UE đưa request vào ring UL
+    HOP_GNB_UL,     // gNB uplink lấy khỏi ring UL
+    HOP_AMF_RX,     // AMF nhận
+    HOP_AMF_TX,     // AMF gửi response/paging
+    HOP_GNB_DL,     // gNB downlink đẩy vào ring DL
+    HOP_UE_DEQ,     // UE lấy khỏi ring DL
+    HOP_COUNT
+};
+
+// trace mang theo bản tin; t0_ns = 0 nghĩa là không trace
+typedef struct {
+    uint32_t id;
+    uint32_t hop_us[HOP_COUNT];
+    uint32_t reserved;      // giữ t0_ns align 8
+    uint64_t t0_ns;         // CLOCK_MONOTONIC lúc tạo trace (attach: UE gửi, paging: AMF gửi)
+} Trace;
+
+// bản tin chung cho UE <-> gNB (shm) và gNB <-> AMF (SCTP), 64 byte
+typedef struct {
+    uint8_t msgid;
+    uint8_t version;     // WIRE_VERSION
+    uint8_t bitmask;
+    uint8_t cause;       // CAUSE_* cho bản tin reject, 0 với bản tin khác
+    uint32_t ue_id;      // 32 bit để chạy tới hàng triệu UE
+    uint64_t tmsi;
+    uint64_t s_tmsi;
+    Trace trace;
+} Message;
+
+// init message AMF gửi gNB để gán capacity
+typedef struct {
+    uint8_t msgid;       // MSG_INIT
+    uint8_t version;
+    uint8_t pad[2];
+    int32_t amf_id;
+    int32_t capacity;
+} InitMessage;
+
+_Static_assert(sizeof(Trace) == 40 && offsetof(Trace, t0_ns) == 32, "Trace wire layout");
+_Static_assert(sizeof(Message) == 64 && offsetof(Message, ue_id) == 4 &&
+               offsetof(Message, tmsi) == 8 && offsetof(Message, s_tmsi) == 16 &&
+               offsetof(Message, trace) == 24, "Message wire layout");
+_Static_assert(sizeof(InitMessage) == 12 && offsetof(InitMessage, amf_id) == 4, "InitMessage wire layout");
+
+// buf dài len có đúng là bản tin msgid, kích thước size, cùng version không
+static inline int wire_is(const void *buf, int len, uint8_t msgid, size_t size) {
+    const uint8_t *b = (const uint8_t *)buf;
+    return len == (int)size && b[0] == msgid && b[1] == WIRE_VERSION;
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+// đổi byte order tại chỗ; gọi ngay trước khi gửi và ngay sau khi nhận (phép đổi là đối xứng)
+static inline void msg_wire_order(Message *m) {
+    m->ue_id = __builtin_bswap32(m->ue_id);
+    m->tmsi = __builtin_bswap64(m->tmsi);
+    m->s_tmsi = __builtin_bswap64(m->s_tmsi);
+    m->trace.id = __builtin_bswap32(m->trace.id);
+    for (int h = 0; h < HOP_COUNT; h++) m->trace.hop_us[h] = __builtin_bswap32(m->trace.hop_us[h]);
+    m->trace.t0_ns = __builtin_bswap64(m->trace.t0_ns);
+}
+
+// bản tin điều khiển: header 4 byte rồi toàn field 32 bit
+static inline void wire_ctl_order(void *buf, size_t size) {
+    uint32_t *w = (uint32_t *)buf;
+    for (size_t k = 1; k < size / 4; k++) w[k] = __builtin_bswap32(w[k]);
+}
+
+static inline uint16_t wire16(uint16_t v) { return __builtin_bswap16(v); }
+#else
+static inline void msg_wire_order(Message *m) { (void)m; }
+static inline void wire_ctl_order(void *buf, size_t size) { (void)buf; (void)size; }
+static inline uint16_t wire16(uint16_t v) { return v; }
+#endif
+
+#endif
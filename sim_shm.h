@@ -0,0 +1,122 @@
+#ifndef SIM_SHM_H
+#define SIM_SHM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include "shm_ring.h"
+#include "doorbell.h"
+
+/*
+ * Layout shm UE <-> gNB. Kích thước tính lúc chạy từ số UE và số shard;
+ * header ghi magic/version/num_ue/num_shards để gNB kiểm tra và lấy cấu hình
+ * từ UE process. UE process tạo segment, gNB chỉ attach.
+ * UE chia thành num_shards shard, shard k giữ dải UE liên tục
+ * [k * shard_ues, (k + 1) * shard_ues) cùng ring UL/DL riêng: mỗi ring vẫn
+ * SPSC (một shard UE <-> một thread gNB), gNB uplink thread chờ trên ul_bell
+ * chung và drain lần lượt các shard.
+ */
+#define SHM_NAME    "/5g_sim_shm"  // mặc định; mỗi cặp UE/gNB chạy song song dùng tên riêng (-n)
+#define SHM_MAGIC   0x35475348u   // "5GSH"
+#define SHM_VERSION 7
+#define SHM_MAX_SHARDS 64         // gNB đánh dấu shard có bản tin DL bằng bitmask 64 bit
+
+typedef struct {
+    _Atomic uint32_t magic;   // ghi sau cùng, gNB thấy magic là header đã đầy đủ
+    uint32_t version;
+    uint32_t num_ue;
+    uint32_t ring_cap;
+    uint32_t num_shards;
+    uint32_t shard_ues;       // số UE mỗi shard (shard cuối có thể ít hơn)
+    uint64_t size;            // tổng kích thước segment
+} ShmHeader;
+
+typedef struct {
+    MsgRing ul;             // ring bản tin UL: shard UE -> gNB
+    MsgRing dl;             // ring bản tin DL: gNB -> shard UE (producer: gNB downlink thread)
+    MsgRing dl_ctl;         // reject/backoff gNB -> shard UE (producer: gNB uplink thread)
+    Doorbell dl_bell;       // gNB báo shard có bản tin DL
+    uint32_t first_ue;
+    uint32_t num_ue;
+} ShmShard;
+
+typedef struct {
+    ShmHeader hdr;
+    Doorbell ul_bell;       // mọi shard UE báo gNB có bản tin UL
+    ShmShard shard[];       // num_shards phần tử, theo sau là uint8_t ue_states[num_ue]
+} SharedMemory;
+
+static inline size_t shm_size(uint32_t num_ue, uint32_t num_shards) {
+    return sizeof(SharedMemory) + (size_t)num_shards * sizeof(ShmShard) + (size_t)num_ue * sizeof(uint8_t);
+}
+
+// trạng thái UE, 1 byte/UE (UE ghi, gNB đọc để monitor), num_ue phần tử
+static inline uint8_t *shm_states(SharedMemory *shm) {
+    return (uint8_t *)&shm->shard[shm->hdr.num_shards];
+}
+
+static inline ShmShard *shm_shard_of(SharedMemory *shm, uint32_t ue_id) {
+    return &shm->shard[ue_id / shm->hdr.shard_ues];
+}
+
+// UE process: tạo (hoặc tạo lại) segment cho num_ue UE chia num_shards shard, ring rỗng
+static inline SharedMemory *shm_create(const char *name, uint32_t num_ue, uint32_t num_shards) {
+    size_t size = shm_size(num_ue, num_shards);
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0666);
+    if (fd < 0) { perror("shm_open"); exit(1); }
+    if (ftruncate(fd, size) < 0) { perror("ftruncate"); exit(1); }
+    SharedMemory *shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED) { perror("mmap"); exit(1); }
+    close(fd);
+    memset(shm, 0, size);
+    shm->hdr.version = SHM_VERSION;
+    shm->hdr.num_ue = num_ue;
+    shm->hdr.ring_cap = RING_CAP;
+    shm->hdr.num_shards = num_shards;
+    shm->hdr.shard_ues = (num_ue + num_shards - 1) / num_shards;
+    shm->hdr.size = size;
+    for (uint32_t k = 0; k < num_shards; k++) {
+        uint32_t first = k * shm->hdr.shard_ues, end = first + shm->hdr.shard_ues;
+        if (first > num_ue) first = num_ue;
+        if (end > num_ue) end = num_ue;
+        shm->shard[k].first_ue = first;
+        shm->shard[k].num_ue = end - first;
+    }
+    atomic_store_explicit(&shm->hdr.magic, SHM_MAGIC, memory_order_release);
+    return shm;
+}
+
+// gNB: attach segment đã có, kiểm tra header rồi map đủ kích thước
+static inline SharedMemory *shm_attach(const char *name) {
+    int fd = shm_open(name, O_RDWR, 0666);
+    if (fd < 0) { perror("gNB shm_open"); exit(1); }
+    ShmHeader *h = mmap(NULL, sizeof(ShmHeader), PROT_READ, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED) { perror("gNB mmap"); exit(1); }
+    if (atomic_load_explicit(&h->magic, memory_order_acquire) != SHM_MAGIC ||
+        h->version != SHM_VERSION || h->ring_cap != RING_CAP ||
+        h->num_shards == 0 || h->num_shards > SHM_MAX_SHARDS) {
+        fprintf(stderr, "gNB: shm %s not initialised or version mismatch (start UE process first)\n", name);
+        exit(1);
+    }
+    size_t size = h->size;
+    munmap(h, sizeof(ShmHeader));
+    SharedMemory *shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED) { perror("gNB mmap"); exit(1); }
+    close(fd);
+    return shm;
+}
+
+// tên log/histogram của process: "proc" với shm mặc định, "proc-<tên shm>" nếu không,
+// để nhiều cặp UE/gNB chạy cùng thư mục không ghi đè file của nhau
+static inline const char *shm_tag(char *buf, size_t n, const char *proc, const char *name) {
+    if (strcmp(name, SHM_NAME) == 0) snprintf(buf, n, "%s", proc);
+    else snprintf(buf, n, "%s-%s", proc, name[0] == '/' ? name + 1 : name);
+    return buf;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef SIM_UTIL_H
+#define SIM_UTIL_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Helper dùng chung cho mọi module: đồng hồ monotonic và hàm băm 64 bit.
+ * Module mới dùng các hàm này thay vì tự viết bản riêng.
+ */
+
+// CLOCK_MONOTONIC: chung cho mọi process trên một host nên mốc của UE / gNB / AMF so được với nhau
+static inline uint64_t sim_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline long long sim_now_us(void) {
+    return (long long)(sim_now_ns() / 1000);
+}
+
+// finalizer của murmur3: khóa liên tiếp (ue_id, S-TMSI, vnode) rải đều trên mọi bit
+static inline uint64_t sim_hash64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef SWEEP_SIMD_H
+#define SWEEP_SIMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Kernel quét mảng trạng thái cho các vòng lặp còn phải đi hết mảng
+ * (monitor gNB, bitmap uplink_ready của UE shard). Bản AVX2 / SSE2 / scalar,
+ * chọn lúc chạy theo CPU (sweep_level, lần gọi đầu tiên). Máy không phải x86
+ * hoặc build với -DSWEEP_NO_SIMD thì chỉ dùng scalar.
+ *   sweep_count_u8_eq      : số byte == v                (UE_CONNECTED trong ue_states)
+ *   sweep_count_nonneg_i32 : số phần tử >= 0             (UE đã gán AMF trong ue_to_amf)
+ *   sweep_nonzero_u64      : mask các word khác 0, tối đa 64 word một lần
+ *                            (word bitmap có UE cần gửi uplink)
+ */
+enum { SWEEP_SCALAR, SWEEP_SSE2, SWEEP_AVX2 };
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(SWEEP_NO_SIMD)
+#define SWEEP_X86 1
+#include <immintrin.h>
+#endif
+
+static int sweep_level = -1;
+
+static inline int sweep_detect(void) {
+#ifdef SWEEP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SWEEP_AVX2;
+    if (__builtin_cpu_supports("sse2")) return SWEEP_SSE2;
+#endif
+    return SWEEP_SCALAR;
+}
+
+static inline int sweep_get_level(void) {
+    if (sweep_level < 0) sweep_level = sweep_detect();   // benign race: mọi thread ghi cùng giá trị
+    return sweep_level;
+}
+
+static inline const char *sweep_level_name(void) {
+    static const char *names[] = { "scalar", "sse2", "avx2" };
+    return names[sweep_get_level()];
+}
+
+// ---------- scalar ----------
+static inline size_t sweep_count_u8_eq_scalar(const uint8_t *a, size_t n, uint8_t v) {
+    size_t c = 0;
+    for (size_t i = 0; i < n; i++) c += a[i] == v;
+    return c;
+}
+
+static inline size_t sweep_count_nonneg_i32_scalar(const int32_t *a, size_t n) {
+    size_t c = 0;
+    for (size_t i = 0; i < n; i++) c += a[i] >= 0;
+    return c;
+}
+
+static inline uint64_t sweep_nonzero_u64_scalar(const uint64_t *w, size_t n) {
+    uint64_t m = 0;
+    for (size_t i = 0; i < n; i++) m |= (uint64_t)(w[i] != 0) << i;
+    return m;
+}
+
+#ifdef SWEEP_X86
+// ---------- SSE2: 16 byte / 4 int / 2 word mỗi lệnh ----------
+// byte: cộng dồn -1 của cmpeq vào bộ đếm 8 bit (tối đa 255 vòng) rồi gộp bằng psadbw
+__attribute__((target("sse2")))
+static inline size_t sweep_count_u8_eq_sse2(const uint8_t *a, size_t n, uint8_t v) {
+    __m128i vv = _mm_set1_epi8((char)v), z = _mm_setzero_si128(), total = z;
+    size_t i = 0;
+    while (i + 16 <= n) {
+        __m128i acc = z;
+        size_t end = i + 255 * 16 < n ? i + 255 * 16 : n;
+        for (; i + 16 <= end; i += 16)
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)), vv));
+        total = _mm_add_epi64(total, _mm_sad_epu8(acc, z));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, total);
+    size_t c = lanes[0] + lanes[1];
+    return c + sweep_count_u8_eq_scalar(a + i, n - i, v);
+}
+
+// int: cộng bit dấu (x >> 31) vào 4 bộ đếm 32 bit
+__attribute__((target("sse2")))
+static inline size_t sweep_count_nonneg_i32_sse2(const int32_t *a, size_t n) {
+    __m128i neg = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        neg = _mm_add_epi32(neg, _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(a + i)), 31));
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, neg);
+    size_t c = i - ((size_t)lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    return c + sweep_count_nonneg_i32_scalar(a + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static inline uint64_t sweep_nonzero_u64_sse2(const uint64_t *w, size_t n) {
+    __m128i z = _mm_setzero_si128();
+    uint64_t m = 0;
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i e = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(w + i)), z);
+        // word bằng 0 khi cả hai nửa 32 bit bằng 0
+        e = _mm_and_si128(e, _mm_shuffle_epi32(e, _MM_SHUFFLE(2, 3, 0, 1)));
+        m |= (uint64_t)(~_mm_movemask_pd(_mm_castsi128_pd(e)) & 3) << i;
+    }
+    return i < n ? m | sweep_nonzero_u64_scalar(w + i, n - i) << i : m;
+}
+
+// ---------- AVX2: 32 byte / 8 int / 4 word mỗi lệnh ----------
+__attribute__((target("avx2")))
+static inline size_t sweep_count_u8_eq_avx2(const uint8_t *a, size_t n, uint8_t v) {
+    __m256i vv = _mm256_set1_epi8((char)v), z = _mm256_setzero_si256(), total = z;
+    size_t i = 0;
+    while (i + 32 <= n) {
+        __m256i acc = z;
+        size_t end = i + 255 * 32 < n ? i + 255 * 32 : n;
+        for (; i + 32 <= end; i += 32)
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)), vv));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(acc, z));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, total);
+    size_t c = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return c + sweep_count_u8_eq_scalar(a + i, n - i, v);
+}
+
+__attribute__((target("avx2")))
+static inline size_t sweep_count_nonneg_i32_avx2(const int32_t *a, size_t n) {
+    __m256i neg = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        neg = _mm256_add_epi32(neg, _mm256_srli_epi32(_mm256_loadu_si256((const __m256i *)(a + i)), 31));
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, neg);
+    size_t sum = 0;
+    for (int k = 0; k < 8; k++) sum += lanes[k];
+    return i - sum + sweep_count_nonneg_i32_scalar(a + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t sweep_nonzero_u64_avx2(const uint64_t *w, size_t n) {
+    __m256i z = _mm256_setzero_si256();
+    uint64_t m = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i e = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(w + i)), z);
+        m |= (uint64_t)(~_mm256_movemask_pd(_mm256_castsi256_pd(e)) & 15) << i;
+    }
+    return i < n ? m | sweep_nonzero_u64_scalar(w + i, n - i) << i : m;
+}
+#endif
+
+// ---------- dispatch ----------
+static inline size_t sweep_count_u8_eq(const uint8_t *a, size_t n, uint8_t v) {
+#ifdef SWEEP_X86
+    switch (sweep_get_level()) {
+    case SWEEP_AVX2: return sweep_count_u8_eq_avx2(a, n, v);
+    case SWEEP_SSE2: return sweep_count_u8_eq_sse2(a, n, v);
+    }
+#endif
+    return sweep_count_u8_eq_scalar(a, n, v);
+}
+
+static inline size_t sweep_count_nonneg_i32(const int32_t *a, size_t n) {
+#ifdef SWEEP_X86
+    switch (sweep_get_level()) {
+    case SWEEP_AVX2: return sweep_count_nonneg_i32_avx2(a, n);
+    case SWEEP_SSE2: return sweep_count_nonneg_i32_sse2(a, n);
+    }
+#endif
+    return sweep_count_nonneg_i32_scalar(a, n);
+}
+
+// n <= 64; bit i của kết quả = (w[i] != 0)
+static inline uint64_t sweep_nonzero_u64(const uint64_t *w, size_t n) {
+#ifdef SWEEP_X86
+    switch (sweep_get_level()) {
+    case SWEEP_AVX2: return sweep_nonzero_u64_avx2(w, n);
+    case SWEEP_SSE2: return sweep_nonzero_u64_sse2(w, n);
+    }
+#endif
+    return sweep_nonzero_u64_scalar(w, n);
+}
+
+#endif
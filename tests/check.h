@@ -0,0 +1,25 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+/*
+ * Kiểm tra tối giản cho test của các header: CHECK sai thì in vị trí và
+ * đếm lỗi, test chạy tiếp; main trả về check_result() (0: pass).
+ */
+static int check_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        check_failures++; \
+    } \
+} while (0)
+
+static inline int check_result(const char *name) {
+    if (check_failures) fprintf(stderr, "%s: %d check(s) failed\n", name, check_failures);
+    else printf("%s: ok\n", name);
+    return check_failures != 0;
+}
+
+#endif
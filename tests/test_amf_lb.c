@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include "check.h"
+#include "amf_lb.h"
+
+/*
+ * Chuỗi join / leave / saturate / report / pick / release ngẫu nhiên trên mọi
+ * chiến lược. Sau mỗi bước: heap đúng thứ tự lb_before, pos và heap khớp nhau,
+ * và AMF nằm trong heap khi và chỉ khi còn nhận được UE.
+ */
+#define N_AMF 16
+#define N_STEPS 40000
+
+static int eligible(const AmfLb *lb, int i) {
+    return lb->up[i] && lb->weight[i] > 0 && lb_used(lb, i) < lb->capacity[i];
+}
+
+static void check_heap(const AmfLb *lb) {
+    int in_heap = 0;
+    for (int k = 0; k < lb->size; k++) {
+        CHECK(lb->pos[lb->heap[k]] == k);
+        if (k > 0) CHECK(!lb_before(lb, lb->heap[k], lb->heap[(k - 1) / 2]));
+    }
+    for (int i = 0; i < lb->n; i++) {
+        CHECK((lb->pos[i] >= 0) == eligible(lb, i));
+        in_heap += lb->pos[i] >= 0;
+    }
+    CHECK(in_heap == lb->size);
+}
+
+static void run(LbStrategy s) {
+    AmfLb lb;
+    lb_init(&lb, N_AMF, s, 1);
+    unsigned int seed = 12345 + s;
+    int assigned[N_AMF] = {0};
+    check_heap(&lb);
+    CHECK(lb_pick(&lb, 1) == -1);
+    for (int step = 0; step < N_STEPS; step++) {
+        int i = rand_r(&seed) % N_AMF;
+        switch (rand_r(&seed) % 8) {
+        case 0: {
+            int cap = 1 + rand_r(&seed) % 50;
+            lb_join(&lb, i, cap, cap);
+            break;
+        }
+        case 1:
+            lb_leave(&lb, i);
+            break;
+        case 2:
+            lb_saturate(&lb, i);
+            break;
+        case 3: {
+            int cap = 1 + rand_r(&seed) % 50;
+            lb_report(&lb, i, rand_r(&seed) % (cap + 10), cap, rand_r(&seed) % 5000);
+            break;
+        }
+        case 4:
+            if (assigned[i] > 0) {
+                lb_release(&lb, i);
+                assigned[i]--;
+            }
+            break;
+        default: {
+            int size = lb.size;
+            int top = size ? lb.heap[0] : -1;
+            int ok_before[N_AMF];
+            for (int k = 0; k < N_AMF; k++) ok_before[k] = lb.pos[k] >= 0;
+            int a = lb_pick(&lb, (uint64_t)rand_r(&seed));
+            CHECK((a < 0) == (size == 0));
+            if (a < 0) break;
+            CHECK(ok_before[a]);
+            if (s == LB_SWRR || s == LB_LEAST) CHECK(a == top);
+            assigned[a]++;
+            break;
+        }
+        }
+        check_heap(&lb);
+        for (int k = 0; k < N_AMF; k++) CHECK(lb.count[k] == assigned[k]);
+    }
+    // mọi AMF rời: heap rỗng, không chọn được AMF nào
+    for (int k = 0; k < N_AMF; k++) lb_leave(&lb, k);
+    check_heap(&lb);
+    CHECK(lb.size == 0);
+    CHECK(lb_pick(&lb, 7) == -1);
+}
+
+// swrr: hai AMF trống cùng capacity, tỉ lệ weight 3:1 thì được chọn theo tỉ lệ đó
+static void run_swrr_share(void) {
+    AmfLb lb;
+    lb_init(&lb, 2, LB_SWRR, 1);
+    lb_join(&lb, 0, 1000, 3);
+    lb_join(&lb, 1, 1000, 1);
+    int n[2] = {0};
+    for (int k = 0; k < 400; k++) n[lb_pick(&lb, k)]++;
+    CHECK(n[0] == 300 && n[1] == 100);
+}
+
+int main(void) {
+    run(LB_SWRR);
+    run(LB_LEAST);
+    run(LB_P2C);
+    run(LB_CHASH);
+    run_swrr_share();
+    return check_result("amf_lb");
+}
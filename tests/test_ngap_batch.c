@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include "check.h"
+#include "ngap_batch.h"
+
+/*
+ * batch_view / paging_view trên datagram cắt cụt hoặc hỏng: không bao giờ trả
+ * về nhiều Message hơn số byte thực có. Datagram nguyên vẹn thì round trip
+ * qua batch_flush / paging_flush giữ nguyên nội dung.
+ */
+static unsigned char wire[sizeof(PagingFrame) > sizeof(BatchFrame) ? sizeof(PagingFrame) : sizeof(BatchFrame)];
+static int wire_len, sends;
+
+static int capture(int fd, const void *buf, size_t len, uint16_t stream) {
+    (void)fd;
+    (void)stream;
+    memcpy(wire, buf, len);
+    wire_len = (int)len;
+    sends++;
+    return (int)len;
+}
+
+static Message msg_for(uint32_t k) {
+    Message m;
+    memset(&m, 0, sizeof(m));
+    m.msgid = MSG_RRC_NGAP_REQ;
+    m.version = WIRE_VERSION;
+    m.ue_id = k;
+    m.tmsi = 0x1000 + k;
+    m.s_tmsi = 0xABC000 + k;
+    return m;
+}
+
+// batch n Message trong wire; trả về độ dài datagram
+static int make_batch(int n) {
+    static MsgBatch b;
+    for (int k = 0; k < n; k++) {
+        Message m = msg_for(k);
+        batch_add(&b, &m);
+    }
+    sends = 0;
+    CHECK(batch_flush(&b, 3, FEAT_BATCH, 0, capture) == n);
+    CHECK(sends == 1);
+    return wire_len;
+}
+
+static void run_batch(void) {
+    static unsigned char buf[sizeof(wire)];
+    Message *msgs;
+    int len = make_batch(5);
+    CHECK(len == (int)(sizeof(BatchHeader) + 5 * sizeof(Message)));
+    memcpy(buf, wire, len);
+    CHECK(batch_view(buf, len, &msgs) == 5);
+    for (int k = 0; k < 5; k++) CHECK(msgs[k].ue_id == (uint32_t)k && msgs[k].tmsi == 0x1000u + k);
+
+    // mọi độ dài cắt cụt của batch đều bị bỏ cả datagram
+    for (int cut = 0; cut < len; cut++) {
+        memcpy(buf, wire, len);
+        int n = batch_view(buf, cut, &msgs);
+        if (n != 0) fprintf(stderr, "batch cut to %d bytes gave %d messages\n", cut, n);
+        CHECK(n == 0);
+    }
+    // count lớn hơn BATCH_MAX hoặc lớn hơn phần thực có
+    len = make_batch(BATCH_MAX);
+    memcpy(buf, wire, len);
+    ((BatchHeader *)buf)->count = wire16(BATCH_MAX + 1);
+    CHECK(batch_view(buf, len, &msgs) == 0);
+    memcpy(buf, wire, len);
+    ((BatchHeader *)buf)->count = wire16(3);   // datagram dài hơn count: lấy đúng count
+    CHECK(batch_view(buf, len, &msgs) == 3);
+    // khác version
+    memcpy(buf, wire, len);
+    ((BatchHeader *)buf)->version = WIRE_VERSION + 1;
+    CHECK(batch_view(buf, len, &msgs) == 0);
+}
+
+static void run_single(void) {
+    static MsgBatch b;
+    Message m = msg_for(9), *msgs;
+    unsigned char buf[sizeof(Message) + 8];
+    batch_add(&b, &m);
+    CHECK(batch_flush(&b, 3, FEAT_BATCH, 0, capture) == 1);   // một Message: không đóng batch
+    CHECK(wire_len == (int)sizeof(Message));
+    memcpy(buf, wire, wire_len);
+    CHECK(batch_view(buf, wire_len, &msgs) == 1 && msgs[0].ue_id == 9);
+    memcpy(buf, wire, wire_len);
+    CHECK(batch_view(buf, wire_len - 1, &msgs) == 0);
+    memcpy(buf, wire, wire_len);
+    CHECK(batch_view(buf, wire_len + 8, &msgs) == 0);   // Message đơn phải đúng cỡ
+    memcpy(buf, wire, wire_len);
+    ((Message *)buf)->version = WIRE_VERSION + 1;
+    CHECK(batch_view(buf, wire_len, &msgs) == 0);
+}
+
+static void run_paging(void) {
+    static PagingList p;
+    static unsigned char buf[sizeof(wire)];
+    PagingRecord *recs;
+    for (int k = 0; k < 7; k++) {
+        Message m = msg_for(k);
+        m.msgid = MSG_NGAP_RRC_PAGING;
+        m.trace.id = 100 + k;
+        paging_add(&p, &m);
+    }
+    CHECK(paging_flush(&p, 3, 0, capture) == 7);
+    int len = wire_len;
+    memcpy(buf, wire, len);
+    CHECK(paging_view(buf, len, &recs) == 7);
+    for (int k = 0; k < 7; k++) {
+        Message m;
+        paging_to_msg(&recs[k], &m);
+        CHECK(m.msgid == MSG_NGAP_RRC_PAGING && m.ue_id == (uint32_t)k);
+        CHECK(m.s_tmsi == 0xABC000u + k && m.trace.id == 100u + k);
+    }
+    for (int cut = 0; cut < len; cut++) {
+        memcpy(buf, wire, len);
+        int n = paging_view(buf, cut, &recs);
+        CHECK(n == (cut < (int)sizeof(BatchHeader) ? -1 : 0));
+    }
+    memcpy(buf, wire, len);
+    ((BatchHeader *)buf)->count = wire16(PAGING_MAX + 1);
+    CHECK(paging_view(buf, len, &recs) == 0);
+    // batch Message không phải paging list
+    len = make_batch(2);
+    memcpy(buf, wire, len);
+    CHECK(paging_view(buf, len, &recs) == -1);
+}
+
+int main(void) {
+    run_batch();
+    run_single();
+    run_paging();
+    return check_result("ngap_batch");
+}
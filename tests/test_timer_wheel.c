@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include "check.h"
+#include "timer_wheel.h"
+
+/*
+ * Timer ở sát biên cascade của từng tầng (63/64/65, 4095/4096/4097, ...) phải
+ * bắn đúng tick expires, đúng một lần, dù wheel bắt đầu lệch biên và được
+ * advance theo bước lớn nhỏ khác nhau.
+ */
+#define N_TIMERS 64
+
+static TimerNode nodes[N_TIMERS];
+static unsigned long long fired_at[N_TIMERS];
+static int fired[N_TIMERS];
+static TimerWheel *cur;
+
+static void on_fire(TimerNode *t, void *arg) {
+    (void)arg;
+    fired[t->id]++;
+    fired_at[t->id] = cur->now;
+}
+
+// arm timer ở các offset quanh biên 64^level tính từ base, advance tới hết, kiểm tra tick bắn
+static void run_boundaries(unsigned long long base, unsigned long long step) {
+    static TimerWheel tw;
+    cur = &tw;
+    tw_init(&tw, base);
+    int n = 0;
+    for (int level = 1; level <= TW_LEVELS; level++) {
+        unsigned long long edge = 1ULL << (TW_BITS * level);
+        // biên tính theo giá trị tuyệt đối của tick (slot đánh theo bit của expires)
+        unsigned long long b = (base / edge + 1) * edge;
+        for (int d = -1; d <= 1; d++) {
+            unsigned long long exp = b + d;
+            nodes[n].id = n;
+            tw_add(&tw, &nodes[n], exp);
+            n++;
+        }
+    }
+    // quá TW_RANGE: bị kẹp rồi cascade lại, vẫn phải bắn đúng tick
+    nodes[n].id = n;
+    tw_add(&tw, &nodes[n], base + TW_RANGE + 5);
+    n++;
+    for (int i = 0; i < n; i++) fired[i] = 0;
+    CHECK(tw.count == n);
+
+    unsigned long long end = 0;
+    for (int i = 0; i < n; i++)
+        if (nodes[i].expires > end) end = nodes[i].expires;
+    end += 10;
+    while (tw.now < end) {
+        long sleep = tw_next_timeout(&tw, tw.now);
+        // không được ngủ qua timer gần nhất
+        for (int i = 0; i < n; i++)
+            if (!fired[i] && sleep >= 0) CHECK(nodes[i].expires >= tw.now + (unsigned long long)sleep);
+        unsigned long long to = tw.now + step;
+        if (to > end) to = end;
+        tw_advance(&tw, to, on_fire, NULL);
+    }
+    CHECK(tw.count == 0);
+    for (int i = 0; i < n; i++) {
+        CHECK(fired[i] == 1);
+        CHECK(fired_at[i] == nodes[i].expires);
+        CHECK(!tw_armed(&nodes[i]));
+    }
+}
+
+// cancel / arm lại không để lại node trong slot cũ
+static void run_cancel(void) {
+    static TimerWheel tw;
+    cur = &tw;
+    tw_init(&tw, 100);
+    for (int i = 0; i < 4; i++) nodes[i].id = i, fired[i] = 0;
+    tw_add(&tw, &nodes[0], 100 + 64);
+    tw_add(&tw, &nodes[1], 100 + 5000);
+    tw_add(&tw, &nodes[2], 50);         // đã quá hạn: bắn ở tick kế tiếp
+    tw_add(&tw, &nodes[3], 100 + 64);
+    tw_cancel(&tw, &nodes[3]);
+    tw_add(&tw, &nodes[1], 100 + 70);   // arm lại gần hơn
+    CHECK(tw.count == 3);
+    tw_advance(&tw, 101, on_fire, NULL);
+    CHECK(fired[2] == 1 && fired_at[2] == 101);
+    tw_advance(&tw, 100 + 6000, on_fire, NULL);
+    CHECK(fired[0] == 1 && fired_at[0] == 164);
+    CHECK(fired[1] == 1 && fired_at[1] == 170);
+    CHECK(fired[3] == 0);
+    CHECK(tw.count == 0);
+    CHECK(tw_next_timeout(&tw, tw.now) == -1);
+}
+
+int main(void) {
+    run_boundaries(0, 1);
+    run_boundaries(1000, 7);
+    run_boundaries((1ULL << 12) - 3, 4099);
+    run_cancel();
+    return check_result("timer_wheel");
+}
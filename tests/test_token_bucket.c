@@ -0,0 +1,58 @@
+#include "check.h"
+#include "token_bucket.h"
+
+/*
+ * Refill theo thời gian caller truyền vào, kẹp ở burst khi rảnh lâu, không
+ * đổi khi đồng hồ lùi; tổng token lấy được trong T giây = burst + rate * T.
+ */
+static void run_refill(void) {
+    TokenBucket tb;
+    tb_init(&tb, 1000, 50, 0);                  // 1 token/ms
+    CHECK(tb_avail(&tb, 0) == 50);              // đầy lúc khởi tạo
+    CHECK(tb_take(&tb, 0, 80) == 50);           // lấy quá burst: chỉ được phần đang có
+    CHECK(tb_take(&tb, 0, 1) == 0);
+    CHECK(tb_wait_ms(&tb) >= 1);
+    CHECK(tb_avail(&tb, 10000) == 10);          // 10 ms
+    CHECK(tb_take(&tb, 10500, 100) == 10);      // 10.5 token: phần lẻ giữ lại
+    CHECK(tb_avail(&tb, 11000) == 1);           // 0.5 + 0.5
+    CHECK(tb_avail(&tb, 5000) == 1);            // đồng hồ lùi: không refill, không mất
+    CHECK(tb.last_us == 11000);
+    CHECK(tb_avail(&tb, 60 * 1000000LL) == 50); // rảnh lâu: kẹp ở burst
+    CHECK(tb_wait_ms(&tb) == 0);
+}
+
+static void run_clamp(void) {
+    TokenBucket tb;
+    tb_init(&tb, 100, 0.2, 0);                  // burst < 1 kẹp lên 1
+    CHECK(tb.burst == 1);
+    CHECK(tb_take(&tb, 0, 5) == 1);
+    CHECK(tb_take(&tb, 5000, 1) == 0);          // 0.5 token
+    CHECK(tb_wait_ms(&tb) == 6);                // 0.5 token ở 100/s = 5 ms, +1 làm tròn lên
+    CHECK(tb_take(&tb, 10000, 1) == 1);
+}
+
+// không giới hạn: lấy bao nhiêu cũng được, không bao giờ phải chờ
+static void run_unlimited(void) {
+    TokenBucket tb;
+    tb_init(&tb, 0, 10, 0);
+    CHECK(tb_take(&tb, 0, 1000000) == 1000000);
+    CHECK(tb_avail(&tb, 0) == INT_MAX);
+    CHECK(tb_wait_ms(&tb) == 0);
+}
+
+// lấy hết mỗi 1 ms trong 2 s: tổng = burst + rate * 2
+static void run_rate(void) {
+    TokenBucket tb;
+    tb_init(&tb, 2500, 100, 0);
+    long total = 0;
+    for (long long t = 0; t <= 2000000; t += 1000) total += tb_take(&tb, t, 1000000);
+    CHECK(total == 100 + 2500 * 2);
+}
+
+int main(void) {
+    run_refill();
+    run_clamp();
+    run_unlimited();
+    run_rate();
+    return check_result("token_bucket");
+}
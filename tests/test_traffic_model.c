@@ -0,0 +1,62 @@
+#include <stdlib.h>
+#include "check.h"
+#include "traffic_model.h"
+
+/*
+ * tm_parse: spec hợp lệ cho đúng tham số, spec sai (model lạ, key lạ, thiếu
+ * '=', giá trị rỗng / không phải số / âm, rate hoặc period bằng 0) bị từ chối.
+ */
+static void run_good(void) {
+    TrafficModel tm;
+    CHECK(tm_parse("storm", &tm) == 0);
+    CHECK(tm.kind == TM_STORM && tm.window_ms == 0 && tm.rate == 100 && tm.off_ms == 1000);
+    CHECK(tm_parse("storm,window=200", &tm) == 0);
+    CHECK(tm.window_ms == 200);
+    CHECK(tm_parse("storm,outage_at=10000,outage=2000", &tm) == 0);
+    CHECK(tm.outage_at_ms == 10000 && tm.outage_ms == 2000);
+    CHECK(tm_parse("poisson,rate=500", &tm) == 0);
+    CHECK(tm.kind == TM_POISSON && tm.rate == 500);
+    CHECK(tm_parse("ramp,rate=2.5", &tm) == 0);
+    CHECK(tm.kind == TM_RAMP && tm.rate == 2.5);
+    CHECK(tm_parse("diurnal,period=60000", &tm) == 0);
+    CHECK(tm.kind == TM_DIURNAL && tm.period_ms == 60000);
+    CHECK(tm_parse("poisson,rate=200,churn=30000,off=5000", &tm) == 0);
+    CHECK(tm.churn_ms == 30000 && tm.off_ms == 5000);
+}
+
+static void run_bad(void) {
+    static const char *bad[] = {
+        "", "burst", "stormy", "stor", "storm ", ",storm",
+        "storm,", "storm,,window=1", "storm,window=5,",
+        "storm,window", "storm,window=", "storm,=5", "storm,windows=5", "storm,foo=1",
+        "storm,window=abc", "storm,window=5ms", "storm,window=-1", "poisson,rate=nan",
+        "poisson,rate=0", "diurnal,period=0", "poisson,rate=-3",
+    };
+    for (size_t k = 0; k < sizeof(bad) / sizeof(bad[0]); k++) {
+        TrafficModel tm;
+        int r = tm_parse(bad[k], &tm);
+        if (r != -1) fprintf(stderr, "accepted bad spec \"%s\"\n", bad[k]);
+        CHECK(r == -1);
+    }
+}
+
+// arrival nằm trong khoảng của model và cùng seed cho cùng chuỗi
+static void run_arrival(void) {
+    TrafficModel tm;
+    CHECK(tm_parse("poisson,rate=1000", &tm) == 0);
+    uint64_t a = tm_seed(7, 3), b = tm_seed(7, 3);
+    for (int k = 0; k < 1000; k++) {
+        int t = tm_arrival_ms(&tm, 1000, &a);
+        CHECK(t >= 0 && t < 1000);
+        CHECK(t == tm_arrival_ms(&tm, 1000, &b));
+    }
+    CHECK(tm_parse("storm,window=0", &tm) == 0);
+    CHECK(tm_arrival_ms(&tm, 10, &a) == 0);
+}
+
+int main(void) {
+    run_good();
+    run_bad();
+    run_arrival();
+    return check_result("traffic_model");
+}
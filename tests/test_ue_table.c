@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include "check.h"
+#include "ue_table.h"
+
+/*
+ * Chỉ mục open addressing so với một mô hình đơn giản: sau mỗi put/del mọi
+ * key còn lại phải tìm thấy (backward shift không làm đứt chuỗi probe), key
+ * đã xóa không còn. Rồi bind / đổi S-TMSI của UeTable và nạp lại từ file.
+ */
+#define N_KEYS 512
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint64_t next_rand(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static void check_index(const CtxIndex *ix, const uint64_t *keys, UeContext *const *vals, int n) {
+    uint32_t live = 0;
+    for (int k = 0; k < n; k++) {
+        UeContext *v = ctx_index_find(ix, keys[k]);
+        CHECK(v == vals[k]);
+        live += vals[k] != NULL;
+    }
+    CHECK(ix->count == live);
+}
+
+static void run_index(void) {
+    static uint64_t keys[N_KEYS];
+    static UeContext *vals[N_KEYS];
+    static UeContext ctx[N_KEYS];
+    CtxIndex ix;
+    ctx_index_init(&ix, 16);   // nhỏ: nhiều lần grow, chuỗi probe dài
+    for (int k = 0; k < N_KEYS; k++) {
+        keys[k] = k + 1;       // khóa liên tiếp như ue_key
+        vals[k] = NULL;
+    }
+    for (int step = 0; step < 20000; step++) {
+        int k = (int)(next_rand() % N_KEYS);
+        if (next_rand() % 3) {
+            ctx_index_put(&ix, keys[k], &ctx[k]);
+            vals[k] = &ctx[k];
+        } else {
+            ctx_index_del(&ix, keys[k]);
+            vals[k] = NULL;
+        }
+        if (step % 97 == 0) check_index(&ix, keys, vals, N_KEYS);
+    }
+    check_index(&ix, keys, vals, N_KEYS);
+    // xóa hết: bảng phải trống hoàn toàn
+    for (int k = 0; k < N_KEYS; k++) ctx_index_del(&ix, keys[k]);
+    CHECK(ix.count == 0);
+    for (uint32_t i = 0; i < ix.cap; i++) CHECK(ix.keys[i] == 0 && ix.vals[i] == NULL);
+    free(ix.keys);
+    free(ix.vals);
+}
+
+static void run_bind(void) {
+    UeTable t;
+    ue_table_init(&t, 8);
+    UeContext *c[3000];
+    for (uint32_t i = 0; i < 3000; i++) {   // nhiều chunk: con trỏ context không đổi
+        c[i] = ue_table_get(&t, 0, i);
+        ue_table_set_stmsi(&t, c[i], 0x1000 + i);
+    }
+    CHECK(t.count == 3000);
+    for (uint32_t i = 0; i < 3000; i++) {
+        CHECK(ue_table_get(&t, 0, i) == c[i]);
+        CHECK(ue_table_find_stmsi(&t, 0x1000 + i) == c[i]);
+    }
+    // UE đi qua gNB khác: vị trí cũ bị gỡ, context giữ nguyên
+    for (uint32_t i = 0; i < 3000; i += 2) CHECK(ue_table_bind(&t, c[i], 1, i + 7));
+    CHECK(ue_table_bind(&t, c[0], 1, 7) == 0);
+    for (uint32_t i = 0; i < 3000; i++) {
+        if (i % 2) {
+            CHECK(ue_table_find_id(&t, 0, i) == c[i]);
+        } else {
+            CHECK(ue_table_find_id(&t, 0, i) == NULL);
+            CHECK(ue_table_find_id(&t, 1, i + 7) == c[i]);
+            CHECK(c[i]->gnb == 1 && c[i]->ue_id == i + 7);
+        }
+    }
+    CHECK(t.by_id.count == 3000);
+    // đổi / bỏ S-TMSI
+    ue_table_set_stmsi(&t, c[5], 0x999999);
+    ue_table_set_stmsi(&t, c[6], 0);
+    CHECK(ue_table_find_stmsi(&t, 0x1000 + 5) == NULL);
+    CHECK(ue_table_find_stmsi(&t, 0x999999) == c[5]);
+    CHECK(ue_table_find_stmsi(&t, 0x1000 + 6) == NULL);
+    CHECK(ue_table_find_stmsi(&t, 0) == NULL);
+    CHECK(t.by_stmsi.count == 2999);
+    CHECK(t.count == 3000);
+}
+
+// context ghi vào file được nạp lại đủ, với vị trí đã bind và S-TMSI mới nhất
+static void run_store(void) {
+    char path[] = "/tmp/ue_table_testXXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    close(fd);
+    UeTable t;
+    ue_table_init(&t, 16);
+    CHECK(ue_table_open(&t, path) == 0);
+    for (uint32_t i = 0; i < 1500; i++) {
+        UeContext *c = ue_table_get(&t, 0, i);
+        ue_table_set_stmsi(&t, c, 0x2000 + i);
+        c->registered = 1;
+        if (i % 3 == 0) ue_table_bind(&t, c, 2, i);
+    }
+    UeTable r;
+    ue_table_init(&r, 16);
+    CHECK(ue_table_open(&r, path) == 1500);
+    for (uint32_t i = 0; i < 1500; i++) {
+        UeContext *c = ue_table_find_stmsi(&r, 0x2000 + i);
+        CHECK(c && c->registered && !tw_armed(&c->paging_timer));
+        CHECK(ue_table_find_id(&r, i % 3 == 0 ? 2 : 0, i) == c);
+    }
+    unlink(path);
+}
+
+int main(void) {
+    run_index();
+    run_bind();
+    run_store();
+    return check_result("ue_table");
+}
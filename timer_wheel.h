@@ -0,0 +1,128 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+
+/*
+ * Timing wheel phân cấp, tick 1 ms: TW_LEVELS tầng x TW_SLOTS slot.
+ * Timer là node nhúng trong context của caller (intrusive list) nên
+ * add/cancel là O(1) và không cấp phát. Wheel không thread-safe:
+ * mỗi wheel chỉ do một thread sở hữu hoặc caller tự khóa.
+ */
+#define TW_BITS   6
+#define TW_SLOTS  (1 << TW_BITS)
+#define TW_MASK   (TW_SLOTS - 1)
+#define TW_LEVELS 4
+#define TW_RANGE  (1ULL << (TW_BITS * TW_LEVELS))   // ~4.6 giờ
+
+typedef struct TimerNode {
+    struct TimerNode *next, *prev;   // prev == NULL: timer chưa được arm
+    unsigned long long expires;      // ms
+    int id;                          // do caller gán (vd: ue index)
+} TimerNode;
+
+typedef struct {
+    unsigned long long now;          // tick cuối cùng đã xử lý
+    int count;                       // số timer đang arm
+    TimerNode slots[TW_LEVELS][TW_SLOTS];   // sentinel của mỗi slot
+} TimerWheel;
+
+typedef void (*TimerFn)(TimerNode *t, void *arg);
+
+static inline void tw_init(TimerWheel *tw, unsigned long long now) {
+    tw->now = now;
+    tw->count = 0;
+    for (int l = 0; l < TW_LEVELS; l++)
+        for (int s = 0; s < TW_SLOTS; s++)
+            tw->slots[l][s].next = tw->slots[l][s].prev = &tw->slots[l][s];
+}
+
+static inline int tw_armed(const TimerNode *t) {
+    return t->prev != NULL;
+}
+
+// exp >= tw->now; exp == tw->now chỉ hợp lệ khi cascade trong tw_advance
+static inline void tw_link(TimerWheel *tw, TimerNode *t, unsigned long long exp) {
+    if (exp - tw->now >= TW_RANGE) exp = tw->now + TW_RANGE - 1;  // xa quá: cascade lại sau
+    unsigned long long delta = exp - tw->now;
+    int level = 0;
+    while (level < TW_LEVELS - 1 && delta >= (1ULL << (TW_BITS * (level + 1)))) level++;
+    TimerNode *head = &tw->slots[level][(exp >> (TW_BITS * level)) & TW_MASK];
+    t->next = head;
+    t->prev = head->prev;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+static inline void tw_unlink(TimerNode *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+}
+
+static inline void tw_cancel(TimerWheel *tw, TimerNode *t) {
+    if (!tw_armed(t)) return;
+    tw_unlink(t);
+    tw->count--;
+}
+
+// arm (hoặc arm lại) timer hết hạn tại expires (ms)
+static inline void tw_add(TimerWheel *tw, TimerNode *t, unsigned long long expires) {
+    tw_cancel(tw, t);
+    t->expires = expires;
+    // quá hạn thì bắn ở tick kế tiếp
+    tw_link(tw, t, expires > tw->now ? expires : tw->now + 1);
+    tw->count++;
+}
+
+// chuyển toàn bộ timer của một slot tầng cao xuống tầng thấp hơn
+static inline void tw_cascade(TimerWheel *tw, int level) {
+    TimerNode *head = &tw->slots[level][(tw->now >> (TW_BITS * level)) & TW_MASK];
+    TimerNode *t = head->next;
+    head->next = head->prev = head;
+    while (t != head) {
+        TimerNode *nx = t->next;
+        tw_link(tw, t, t->expires > tw->now ? t->expires : tw->now);
+        t = nx;
+    }
+}
+
+// tiến wheel tới thời điểm now, gọi fn cho từng timer đến hạn
+static inline void tw_advance(TimerWheel *tw, unsigned long long now, TimerFn fn, void *arg) {
+    if (tw->count == 0) {
+        if (now > tw->now) tw->now = now;
+        return;
+    }
+    while (tw->now < now) {
+        tw->now++;
+        // cascade từ tầng cao xuống để timer về đúng slot tầng 0 của tick này
+        int top = 0;
+        while (top < TW_LEVELS - 1 &&
+               (tw->now & ((1ULL << (TW_BITS * (top + 1))) - 1)) == 0) top++;
+        for (int l = top; l > 0; l--) tw_cascade(tw, l);
+
+        TimerNode *head = &tw->slots[0][tw->now & TW_MASK];
+        while (head->next != head) {
+            TimerNode *t = head->next;
+            tw_unlink(t);
+            tw->count--;
+            fn(t, arg);
+        }
+        if (tw->count == 0) {
+            if (now > tw->now) tw->now = now;
+            return;
+        }
+    }
+}
+
+// số ms tối đa có thể ngủ trước khi cần gọi tw_advance (-1: không có timer)
+static inline long tw_next_timeout(const TimerWheel *tw, unsigned long long now) {
+    if (tw->count == 0) return -1;
+    unsigned long long t = tw->now + 1;
+    unsigned long long boundary = (tw->now | TW_MASK) + 1;   // lần cascade kế tiếp
+    for (; t < boundary; t++)
+        if (tw->slots[0][t & TW_MASK].next != &tw->slots[0][t & TW_MASK]) break;
+    return t > now ? (long)(t - now) : 0;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+#include <limits.h>
+
+/*
+ * Token bucket giới hạn tốc độ: rate token/s, tích tối đa burst token.
+ * Thời gian do caller truyền vào (µs, monotonic) nên dùng được trong vòng
+ * lặp đã có sẵn mốc thời gian. rate <= 0: không giới hạn.
+ * Không thread-safe: mỗi bucket do một thread sở hữu.
+ */
+typedef struct {
+    double rate;        // token/s
+    double burst;
+    double tokens;
+    long long last_us;
+} TokenBucket;
+
+static inline void tb_init(TokenBucket *tb, double rate, double burst, long long now_us) {
+    tb->rate = rate;
+    tb->burst = burst < 1 ? 1 : burst;
+    tb->tokens = tb->burst;
+    tb->last_us = now_us;
+}
+
+static inline void tb_refill(TokenBucket *tb, long long now_us) {
+    if (now_us <= tb->last_us) return;
+    tb->tokens += (now_us - tb->last_us) * tb->rate / 1e6;
+    if (tb->tokens > tb->burst) tb->tokens = tb->burst;
+    tb->last_us = now_us;
+}
+
+// lấy tối đa want token, trả về số token lấy được
+static inline int tb_take(TokenBucket *tb, long long now_us, int want) {
+    if (tb->rate <= 0) return want;
+    tb_refill(tb, now_us);
+    int n = tb->tokens < want ? (int)tb->tokens : want;
+    tb->tokens -= n;
+    return n;
+}
+
+// số token lấy được ngay mà không lấy (INT_MAX: không giới hạn)
+static inline int tb_avail(TokenBucket *tb, long long now_us) {
+    if (tb->rate <= 0) return INT_MAX;
+    tb_refill(tb, now_us);
+    return (int)tb->tokens;
+}
+
+// ms tới khi có token kế tiếp (0: có ngay)
+static inline long tb_wait_ms(const TokenBucket *tb) {
+    if (tb->rate <= 0 || tb->tokens >= 1) return 0;
+    return (long)((1 - tb->tokens) * 1000 / tb->rate) + 1;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef TRAFFIC_MODEL_H
+#define TRAFFIC_MODEL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Mô hình traffic cho UE process: thời điểm attach lần đầu của từng UE,
+ * outage giả lập và detach/re-attach (churn). Spec dạng
+ * "model[,key=value...]", ví dụ:
+ *   storm,window=200              mọi UE attach trong 200 ms đầu (window=0: cùng lúc)
+ *   storm,outage_at=10000,outage=2000
+ *                                 t=10s mất registration toàn mạng, 2s sau attach storm lại
+ *   poisson,rate=500              arrival Poisson 500 UE/s
+ *   ramp,rate=500                 tốc độ arrival tăng tuyến tính 0 -> 500 UE/s
+ *   diurnal,period=60000          arrival theo profile 24 giờ nén vào period ms
+ *   poisson,rate=200,churn=30000,off=5000
+ *                                 UE detach sau ~Exp(30s), re-attach sau ~Exp(5s)
+ * Mỗi UE có RNG splitmix64 riêng seed từ (seed, ue index) nên cùng seed cho
+ * cùng một chuỗi sự kiện, không phụ thuộc thứ tự thread gọi rand().
+ * Không dùng libm: exp/ln tự tính (đủ chính xác cho sinh traffic).
+ */
+typedef enum { TM_STORM, TM_POISSON, TM_RAMP, TM_DIURNAL } TmKind;
+
+typedef struct {
+    TmKind kind;
+    double rate;         // UE/s (poisson: trung bình, ramp: đỉnh)
+    int window_ms;       // storm: thời gian rải attach
+    int period_ms;       // diurnal: độ dài một "ngày"
+    int outage_at_ms;    // 0: không có outage
+    int outage_ms;       // thời gian mạng mất trước khi attach storm lại
+    int churn_ms;        // thời gian attach trung bình trước khi detach, 0: không churn
+    int off_ms;          // thời gian detach trung bình trước khi re-attach
+} TrafficModel;
+
+// tải tương đối theo giờ trong ngày (0..23), đỉnh buổi tối
+static const uint8_t tm_diurnal_profile[24] = {
+    30, 20, 15, 12, 12, 15, 25, 45, 65, 75, 80, 82,
+    85, 82, 80, 80, 85, 90, 95, 100, 95, 80, 60, 40
+};
+
+static inline uint64_t tm_next(uint64_t *s) {
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t tm_seed(uint64_t seed, uint32_t ue) {
+    uint64_t s = seed ^ ((uint64_t)ue << 32 | ue);
+    return tm_next(&s);
+}
+
+// số nguyên đều trong [0, n)
+static inline uint32_t tm_rand(uint64_t *s, uint32_t n) {
+    return (uint32_t)(((tm_next(s) >> 32) * n) >> 32);
+}
+
+// số thực đều trong [0, 1)
+static inline double tm_uniform(uint64_t *s) {
+    return (tm_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// ln(x), x > 0: x = m * 2^e, ln(m) bằng chuỗi atanh (|z| <= 1/3)
+static inline double tm_ln(double x) {
+    int e = 0;
+    while (x >= 2.0) { x *= 0.5; e++; }
+    while (x < 1.0) { x *= 2.0; e--; }
+    double z = (x - 1.0) / (x + 1.0), z2 = z * z;
+    double r = z * (1.0 + z2 * (1.0 / 3 + z2 * (1.0 / 5 + z2 * (1.0 / 7 + z2 * (1.0 / 9 + z2 / 11)))));
+    return 2.0 * r + e * 0.6931471805599453;
+}
+
+// mẫu phân phối mũ trung bình mean_ms
+static inline int tm_exp_ms(uint64_t *s, int mean_ms) {
+    return (int)(-mean_ms * tm_ln(1.0 - tm_uniform(s)));
+}
+
+// thời điểm attach đầu tiên (ms tính từ lúc start) của một UE trong num_ue UE
+static inline int tm_arrival_ms(const TrafficModel *tm, int num_ue, uint64_t *s) {
+    switch (tm->kind) {
+    case TM_POISSON: {
+        // N điểm đều trên [0, T] = quá trình Poisson tốc độ N/T có điều kiện N arrival
+        double t = num_ue * 1000.0 / tm->rate;
+        return (int)(tm_uniform(s) * t);
+    }
+    case TM_RAMP: {
+        // mật độ tăng tuyến tính trên [0, T], T = 2N / rate; max 2 số đều có CDF u^2
+        double t = 2.0 * num_ue * 1000.0 / tm->rate;
+        double a = tm_uniform(s), b = tm_uniform(s);
+        return (int)((a > b ? a : b) * t);
+    }
+    case TM_DIURNAL: {
+        // chọn giờ theo profile (rejection sampling), rồi đều trong giờ đó
+        int h;
+        do h = tm_rand(s, 24); while (tm_rand(s, 100) >= tm_diurnal_profile[h]);
+        return (int)((h + tm_uniform(s)) * tm->period_ms / 24);
+    }
+    default:
+        return tm->window_ms > 0 ? (int)tm_rand(s, tm->window_ms + 1) : 0;
+    }
+}
+
+static inline int tm_parse(const char *spec, TrafficModel *tm) {
+    static const char *names[] = { "storm", "poisson", "ramp", "diurnal" };
+    memset(tm, 0, sizeof(*tm));
+    tm->rate = 100;
+    tm->period_ms = 60000;
+    tm->off_ms = 1000;
+    size_t len = strcspn(spec, ",");
+    int k;
+    for (k = 0; k < 4; k++)
+        if (strlen(names[k]) == len && strncmp(spec, names[k], len) == 0) break;
+    if (k == 4) return -1;
+    tm->kind = (TmKind)k;
+    for (const char *p = strchr(spec, ','); p; p = strchr(p, ',')) {
+        p++;
+        len = strcspn(p, ",");
+        const char *eq = memchr(p, '=', len);
+        if (!eq) return -1;
+        size_t kl = (size_t)(eq - p);
+        char *end;
+        double v = strtod(eq + 1, &end);
+        // giá trị phải là cả phần sau '=' (không rỗng, không "5ms"), không âm / NaN
+        if (end == eq + 1 || end != p + len || !(v >= 0)) return -1;
+        if (kl == 4 && !strncmp(p, "rate", 4)) tm->rate = v;
+        else if (kl == 6 && !strncmp(p, "window", 6)) tm->window_ms = (int)v;
+        else if (kl == 6 && !strncmp(p, "period", 6)) tm->period_ms = (int)v;
+        else if (kl == 9 && !strncmp(p, "outage_at", 9)) tm->outage_at_ms = (int)v;
+        else if (kl == 6 && !strncmp(p, "outage", 6)) tm->outage_ms = (int)v;
+        else if (kl == 5 && !strncmp(p, "churn", 5)) tm->churn_ms = (int)v;
+        else if (kl == 3 && !strncmp(p, "off", 3)) tm->off_ms = (int)v;
+        else return -1;
+    }
+    if (tm->rate <= 0 || tm->period_ms <= 0) return -1;
+    return 0;
+}
+
+#endif
@@ -3,21 +3,25 @@
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <sys/mman.h>
 #include <time.h>
 #include <stdint.h>
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <signal.h>
+#include "sim_msg.h"
+#include "sim_shm.h"
+#include "timer_wheel.h"
+#include "latency_hist.h"
+#include "log.h"
+#include "traffic_model.h"
+#include "sweep_simd.h"
 
-#define NUM_UE 200
-#define SHM_NAME "/5g_sim_shm"
-#define SHM_SIZE (sizeof(SharedMemory))
-
-#define MSG_UE_RRC_CONNECTION_REQUEST 0x10
-#define MSG_RRC_UE_CONNECTION_RESPONSE 0x11
-#define MSG_RRC_UE_PAGING             0x15
-#define BM_RANDOM_VALUE 0x01
-#define BM_5G_STMSI     0x02
+#define DEFAULT_NUM_UE 200
+#define BACKOFF_MIN_MS 100     // backoff sau reject, nhân đôi mỗi lần tới BACKOFF_MAX_SHIFT
+#define BACKOFF_MAX_SHIFT 5
+#define DEFAULT_TRAFFIC "storm"   // mọi UE attach ngay lúc start
+#define DEFAULT_SHARDS 1
 
 enum UE_State {
     UE_IDLE,
@@ -25,36 +29,59 @@ enum UE_State {
     UE_CONNECTED
 };
 
-typedef struct {
-    uint8_t msgid;
-    uint8_t bitmask;
-    uint16_t ue_id;
-    uint64_t tmsi;
-    uint64_t s_tmsi;
-} Message;
+#define UE_TMSI_BASE 452040000000001ULL   // tmsi = base + ue_offset + ue index
 
-typedef struct {
-    pthread_mutex_t mutex;
-    Message ul[NUM_UE];     // lưu bản tin UL
-    int ul_ready[NUM_UE];   // flag báo hiệu có bản tin UL
-    Message dl[NUM_UE];     // lưu bản tin DL
-    int dl_ready[NUM_UE];   // flag báo hiệu có bản tin DL
-    int ue_states[NUM_UE];  // Lưu trạng thái của UEs
-} SharedMemory;
+// cờ trong ue.flags
+#define UF_BACKOFF 0x01   // x_timer đang là timer backoff sau reject
+#define UF_DETACH  0x02   // tm_timer là detach (churn), không set: attach lần đầu / re-attach
 
 SharedMemory *shm = NULL;
+int num_ue = DEFAULT_NUM_UE;
+// chỉ số UE toàn cục của UE 0: nhiều UE process (mỗi process một gNB) dùng dải
+// khác nhau để TMSI/S-TMSI không trùng nhau trong AMF dùng chung
+uint32_t ue_offset = 0;
+
+/*
+ * Context UE dạng structure-of-arrays, index theo ue id. Phần nóng (state,
+ * flags, bit uplink_ready) nhỏ và liền nhau; phần lạnh (s_tmsi, RNG, trace,
+ * timer) chỉ bị đụng khi UE có sự kiện. state nằm luôn trong shm (1 byte/UE)
+ * nên không còn bản sao cho gNB. uplink_ready là bitmap theo shard: uplink
+ * thread chỉ duyệt các word khác 0 thay vì quét mọi UE.
+ */
+typedef struct {
+    uint8_t *state;         // UE_State, trong shm (gNB đọc); downlink thread ghi
+    uint8_t *flags;         // UF_*, downlink thread sở hữu
+    uint64_t *s_tmsi;
+    uint16_t *x;            // delay Registered -> Idle (ms)
+    uint8_t *retries;       // số reject liên tiếp
+    uint64_t *rng;          // RNG riêng của UE (traffic_model.h)
+    Trace *trace;           // trace của thủ tục đang chạy (attach / paging -> connect), t0_ns = 0 nếu không có
+    TimerNode *x_timer;     // timer Registered -> Idle (hoặc backoff khi IDLE), do downlink thread sở hữu
+    TimerNode *tm_timer;    // sự kiện traffic model: attach lần đầu / re-attach hoặc detach (churn)
+} UeSoA;
 
+/*
+ * Shard: dải UE liên tục [first, first + n) với ring pair riêng tới gNB,
+ * một uplink thread và một downlink + timer thread. Shard không chia sẻ gì
+ * với nhau ngoài các mảng UE (mỗi shard chỉ đụng dải của mình), nên chạy được
+ * dưới dạng thread trong một process hoặc mỗi shard một process (-P).
+ */
 typedef struct {
     int idx;
-    uint64_t tmsi;
-    uint64_t s_tmsi;
-    int x;               // delay để Registered -> Idle timer (ms)
-    enum UE_State state;
-    unsigned long long next_action_time;
-    int uplink_ready;   // trigger attach uplink 
-} UECtx;
+    int first, n;
+    ShmShard *ring;         // ring UL/DL của shard trong shm
+    _Atomic uint64_t *ready;// bitmap uplink_ready, bit (i - first); downlink set, uplink lấy ra
+    int ready_words;
+    TimerWheel x_wheel;     // wheel của downlink thread cho timer x / backoff / traffic
+    Doorbell ul_work;       // downlink thread báo uplink thread có UE uplink_ready
+    TimerNode outage_timer; // outage giả lập, id = -1
+    unsigned long long now; // thời điểm của lượt tw_advance hiện tại
+} UeShard;
 
-UECtx ue_list[NUM_UE];
+UeSoA ue;
+UeShard *shards;
+int num_shards = DEFAULT_SHARDS;
+TrafficModel traffic;
 
 unsigned long long current_millis() {
     struct timeval tv;
@@ -62,151 +89,380 @@ unsigned long long current_millis() {
     return tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
 }
 
-static inline int rand_step500() {
-    return 500 * (rand() % 6 + 1);  // 500..3000 ms
+static inline int rand_step500(uint64_t *rng) {
+    return 500 * (tm_rand(rng, 6) + 1);  // 500..3000 ms
+}
+
+// đánh dấu UE i cần gửi uplink (không đánh thức uplink thread)
+static inline void ue_set_ready(UeShard *s, int i) {
+    int b = i - s->first;
+    atomic_fetch_or_explicit(&s->ready[b >> 6], 1ULL << (b & 63), memory_order_release);
+}
+
+static inline int ue_is_ready(UeShard *s, int i) {
+    int b = i - s->first;
+    return (atomic_load_explicit(&s->ready[b >> 6], memory_order_relaxed) >> (b & 63)) & 1;
+}
+
+static inline void ue_mark_ready(UeShard *s, int i) {
+    ue_set_ready(s, i);
+    doorbell_ring(&s->ul_work);
+}
+
+// hàm gửi batch bản tin UL, trả về số bản tin đã vào ring
+int send_ul_msgs(UeShard *s, const Message *m, int n) {
+    int sent = (int)ring_enqueue_burst(&s->ring->ul, m, n);
+    if (sent > 0) doorbell_ring(&shm->ul_bell);
+    return sent;
 }
 
-// hàm khởi tạo Shared Memory
-static void init_shm() {
-    int fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666);
-    ftruncate(fd, SHM_SIZE);
-    shm = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    memset(shm, 0, SHM_SIZE);
-    pthread_mutexattr_t a;
-    pthread_mutexattr_init(&a);
-    pthread_mutexattr_setpshared(&a, PTHREAD_PROCESS_SHARED);
-    pthread_mutex_init(&shm->mutex, &a);
+// hàm nhận batch bản tin DL: response/paging trước, sau đó reject từ ring dl_ctl
+int poll_dl_msgs(UeShard *s, Message *out, int max) {
+    int n = (int)ring_dequeue_burst(&s->ring->dl, out, max);
+    if (n == 0) n = (int)ring_dequeue_burst(&s->ring->dl_ctl, out, max);
+    return n;
 }
 
-// hàm gửi bản tin UL
-void send_ul_msg(int idx, Message *m) {
-    pthread_mutex_lock(&shm->mutex);
-    shm->ul[idx] = *m;
-    shm->ul_ready[idx] = 1;
-    pthread_mutex_unlock(&shm->mutex);
+// đẩy batch UL vào ring; UE chưa vào được ring được đánh dấu ready lại để gửi vòng sau
+static int flush_ul_batch(UeShard *s, const Message *batch, const int *owner, int n) {
+    int sent = send_ul_msgs(s, batch, n);
+    for (int k = sent; k < n; k++) ue_set_ready(s, owner[k]);
+    return sent;
 }
 
-// hàm nhận bản tin DL
-int poll_dl_msg(int idx, Message *out) {
-    int got = 0;
-    pthread_mutex_lock(&shm->mutex);
-    if (shm->dl_ready[idx]) {
-        *out = shm->dl[idx];
-        shm->dl_ready[idx] = 0;
-        got = 1;
+// lấy word w của bitmap ready, tạo request cho các UE trong word và gửi mỗi khi đủ RING_BURST;
+// trả về 1 nếu ring đầy (phần chưa gửi được đánh dấu ready lại)
+static int ul_take_word(UeShard *s, int w, Message *batch, int *owner, int *n, uint32_t *trace_seq) {
+    uint64_t bits = atomic_exchange_explicit(&s->ready[w], 0, memory_order_acquire);
+    for (; bits; bits &= bits - 1) {
+        int i = s->first + w * 64 + __builtin_ctzll(bits);
+        if (ue.state[i] != UE_IDLE) continue;
+
+        Message *req = &batch[*n];
+        req->msgid  = MSG_UE_RRC_CONNECTION_REQUEST;
+        req->version = WIRE_VERSION;
+        req->ue_id  = i;
+        req->tmsi   = UE_TMSI_BASE + ue_offset + i;
+
+        if (ue.s_tmsi[i] == 0) { // attach lần đầu
+            req->bitmask = BM_RANDOM_VALUE;
+            req->s_tmsi  = 0;
+        } else { // re-attach sau Paging
+            req->bitmask = BM_5G_STMSI;
+            req->s_tmsi  = ue.s_tmsi[i];
+            LOG_DBG("[UE %d] Sending re-attach with S-TMSI=0x%llx",
+                   i, (unsigned long long)ue.s_tmsi[i]);
+        }
+        // attach giữ t0 của lần gửi đầu qua các lần retry; re-attach dùng trace của paging
+        if (!ue.trace[i].t0_ns) trace_start(&ue.trace[i], ++*trace_seq);
+        req->cause = 0;
+        req->trace = ue.trace[i];
+        trace_stamp(&req->trace, HOP_UE_ENQ);
+        owner[(*n)++] = i;
+        if (*n == RING_BURST) {
+            int sent = flush_ul_batch(s, batch, owner, *n);
+            *n = 0;
+            if (sent < RING_BURST) {   // ring đầy: trả phần còn lại của word, đợi vòng sau
+                bits &= bits - 1;
+                if (bits) atomic_fetch_or_explicit(&s->ready[w], bits, memory_order_release);
+                return 1;
+            }
+        }
     }
-    pthread_mutex_unlock(&shm->mutex);
-    return got;
+    return 0;
 }
 
-/* uplink thread: check uplink_ready cho toàn bộ UE */
+/* uplink thread: lấy các UE uplink_ready từ bitmap của shard, gửi theo batch */
 void *uplink_thread(void *arg) {
+    UeShard *s = arg;
+    Message batch[RING_BURST];
+    int owner[RING_BURST];
+    uint32_t trace_seq = (uint32_t)s->idx << 24;   // trace id không trùng giữa các shard
     while (1) {
-        for (int i = 0; i < NUM_UE; i++) {
-            UECtx *ue = &ue_list[i];
-            if (ue->state == UE_CONNECTED) continue;
-            if (ue->state == UE_IDLE && ue->uplink_ready) {
-                Message req;
-                req.msgid  = MSG_UE_RRC_CONNECTION_REQUEST;
-                req.ue_id  = ue->idx;
-                req.tmsi   = ue->tmsi;
-
-                if (ue->s_tmsi == 0) { // attach lần đầu
-                    req.bitmask = BM_RANDOM_VALUE;
-                    req.s_tmsi  = 0;
-                } else { // re-attach sau Paging
-                    req.bitmask = BM_5G_STMSI;
-                    req.s_tmsi  = ue->s_tmsi;
-                    printf("[UE %d] Sending re-attach with S-TMSI=0x%llx\n",
-                           ue->idx, (unsigned long long)ue->s_tmsi);
-                }
-                send_ul_msg(ue->idx, &req);
-                ue->uplink_ready = 0;
-            }
+        uint32_t seen = doorbell_seq(&s->ul_work);
+        int n = 0, full = 0;
+        // tìm word khác 0 theo khối 64 word (4096 UE) bằng sweep_nonzero_u64; đọc không
+        // atomic chỉ để lọc, word được lấy ra bằng atomic_exchange
+        for (int w0 = 0; w0 < s->ready_words && !full; w0 += 64) {
+            int nw = s->ready_words - w0 < 64 ? s->ready_words - w0 : 64;
+            uint64_t live = sweep_nonzero_u64((const uint64_t *)&s->ready[w0], nw);
+            for (; live && !full; live &= live - 1)
+                full = ul_take_word(s, w0 + __builtin_ctzll(live), batch, owner, &n, &trace_seq);
         }
-        usleep(1000);
+        if (n > 0 && flush_ul_batch(s, batch, owner, n) < n) full = 1;
+        // ngủ đến khi có UE uplink_ready mới; ring đầy thì thử lại sau 1ms
+        doorbell_wait(&s->ul_work, seen, full ? 1 : -1);
     }
     return NULL;
 }
 
-/* downlink + timer thread: check DL và timer cho toàn bộ UE */
+// sự kiện traffic model cho UE i tại thời điểm at
+static void tm_schedule(UeShard *s, int i, int detach, unsigned long long at) {
+    if (detach) ue.flags[i] |= UF_DETACH;
+    else ue.flags[i] &= ~UF_DETACH;
+    tw_add(&s->x_wheel, &ue.tm_timer[i], at);
+}
+
+// UE mất registration (detach do churn hoặc outage), attach lại từ đầu tại thời điểm at
+static void ue_detach(UeShard *s, int i, unsigned long long at) {
+    tw_cancel(&s->x_wheel, &ue.x_timer[i]);
+    ue.state[i] = UE_IDLE;
+    ue.s_tmsi[i] = 0;
+    int b = i - s->first;
+    atomic_fetch_and_explicit(&s->ready[b >> 6], ~(1ULL << (b & 63)), memory_order_relaxed);
+    ue.flags[i] &= ~UF_BACKOFF;
+    ue.retries[i] = 0;
+    ue.trace[i].t0_ns = 0;
+    tm_schedule(s, i, 0, at);
+}
+
+// xử lý một bản tin DL cho UE i
+static void handle_dl_msg(UeShard *s, int i, const Message *resp, unsigned long long now) {
+    if (resp->msgid == MSG_RRC_UE_CONNECTION_RESPONSE) {
+        if (ue.state[i] == UE_IDLE && ue.s_tmsi[i] == 0 &&
+            resp->bitmask == BM_RANDOM_VALUE) {
+            ue.s_tmsi[i] = resp->s_tmsi & 0xFFFFFFFFFF;
+            ue.state[i] = UE_REGISTERED;
+            ue.flags[i] &= ~UF_BACKOFF;
+            ue.retries[i] = 0;
+            if (resp->trace.t0_ns) lat_record(LAT_ATTACH, resp->trace.hop_us[HOP_UE_DEQ]);
+            ue.trace[i].t0_ns = 0;
+            tw_add(&s->x_wheel, &ue.x_timer[i], now + ue.x[i]);
+            if (traffic.churn_ms > 0)
+                tm_schedule(s, i, 1, now + tm_exp_ms(&ue.rng[i], traffic.churn_ms));
+            LOG_INF("[UE %d] Registered (S-TMSI=0x%llx)",
+                   i, (unsigned long long)ue.s_tmsi[i]);
+        }
+        else if (ue.state[i] == UE_IDLE && resp->bitmask == BM_5G_STMSI) {
+            ue.state[i] = UE_CONNECTED;
+            if (ue.flags[i] & UF_BACKOFF) tw_cancel(&s->x_wheel, &ue.x_timer[i]);
+            ue.flags[i] &= ~UF_BACKOFF;
+            if (resp->trace.t0_ns) lat_record(LAT_PAGING_CONNECT, resp->trace.hop_us[HOP_UE_DEQ]);
+            ue.trace[i].t0_ns = 0;
+            LOG_INF("[UE %d] Connected after Paging Response", i);
+        }
+    }
+    else if (resp->msgid == MSG_RRC_UE_REJECT && resp->cause == CAUSE_UE_UNKNOWN) {
+        // AMF không còn context (failover): bỏ S-TMSI, đăng ký lại ngay; gNB đã giãn nhịp
+        LOG_WRN("[UE %d] Registration lost (AMF failover), re-attaching", i);
+        ue_detach(s, i, now);
+    }
+    else if (resp->msgid == MSG_RRC_UE_REJECT) {
+        // gNB/AMF quá tải hoặc timeout: gửi lại sau backoff (exponential + jitter)
+        if (ue.state[i] != UE_IDLE || ue_is_ready(s, i) || (ue.flags[i] & UF_BACKOFF)) return;
+        int shift = ue.retries[i] < BACKOFF_MAX_SHIFT ? ue.retries[i] : BACKOFF_MAX_SHIFT;
+        int delay = BACKOFF_MIN_MS << shift;
+        delay += tm_rand(&ue.rng[i], delay);
+        if (ue.retries[i] < UINT8_MAX) ue.retries[i]++;
+        ue.flags[i] |= UF_BACKOFF;
+        tw_add(&s->x_wheel, &ue.x_timer[i], now + delay);
+        LOG_WRN("[UE %d] Rejected (cause=%d), retry in %dms", i, resp->cause, delay);
+    }
+    else if (resp->msgid == MSG_RRC_UE_PAGING) {
+        if ((resp->s_tmsi & 0xFFFFFFFFFF) == ue.s_tmsi[i]) {
+            ue.trace[i] = resp->trace;   // paging -> connect đo từ lúc AMF gửi paging
+            if (ue.flags[i] & UF_BACKOFF) {   // paging gửi lại ngay, bỏ backoff
+                ue.flags[i] &= ~UF_BACKOFF;
+                tw_cancel(&s->x_wheel, &ue.x_timer[i]);
+            }
+            // Trường hợp UE nhận Paging khi vẫn ở UE_REGISTERED do y < x 
+            if (ue.state[i] == UE_REGISTERED) {
+                ue.state[i] = UE_IDLE; // chuyển state UE sang IDLE để gửi bản tin re-attach
+                tw_cancel(&s->x_wheel, &ue.x_timer[i]);
+                LOG_INF("[UE %d] Paging while REGISTERED -> force to IDLE", i);
+            }
+            ue_mark_ready(s, i);
+        }
+    }
+}
+
+// outage: mọi UE mất registration, mạng trở lại sau outage_ms và UE attach storm trong window
+static void on_outage(UeShard *s, unsigned long long now) {
+    LOG_WRN("Simulated outage: shard %d, %d UEs lose registration for %dms", s->idx, s->n, traffic.outage_ms);
+    for (int i = s->first; i < s->first + s->n; i++) {
+        int spread = traffic.window_ms > 0 ? (int)tm_rand(&ue.rng[i], traffic.window_ms + 1) : 0;
+        ue_detach(s, i, now + traffic.outage_ms + spread);
+    }
+}
+
+// sự kiện traffic model đến hạn
+static void on_tm_timer(UeShard *s, int i, unsigned long long now) {
+    if (ue.flags[i] & UF_DETACH) {
+        if (ue.s_tmsi[i] == 0) return;
+        LOG_INF("[UE %d] Detach (churn)", i);
+        ue_detach(s, i, now + tm_exp_ms(&ue.rng[i], traffic.off_ms));
+        return;
+    }
+    if (ue.state[i] != UE_IDLE || ue.s_tmsi[i] != 0 || ue_is_ready(s, i) || (ue.flags[i] & UF_BACKOFF)) return;
+    ue_mark_ready(s, i);
+}
+
+// timer Registered->Idle hết hạn, hết backoff sau reject, hoặc sự kiện traffic model
+static void on_x_timer(TimerNode *t, void *arg) {
+    UeShard *s = arg;
+    int i = t->id;
+    if (i < 0) { on_outage(s, s->now); return; }
+    if (t == &ue.tm_timer[i]) { on_tm_timer(s, i, s->now); return; }
+    if (ue.flags[i] & UF_BACKOFF) {
+        ue.flags[i] &= ~UF_BACKOFF;
+        if (ue.state[i] == UE_IDLE) ue_mark_ready(s, i);
+        return;
+    }
+    if (ue.state[i] != UE_REGISTERED) return;
+    ue.state[i] = UE_IDLE;
+    LOG_INF("[UE %d] Timer expired -> back to IDLE", i);
+}
+
+/* downlink + timer thread: drain ring DL rồi bắn các timer đến hạn */
 void *downlink_thread(void *arg) {
-    Message resp;
+    UeShard *s = arg;
+    Message resp[RING_BURST];
     while (1) {
+        uint32_t seen = doorbell_seq(&s->ring->dl_bell);
         unsigned long long now = current_millis();
-        for (int i = 0; i < NUM_UE; i++) {
-            UECtx *ue = &ue_list[i];
-            if (ue->state == UE_CONNECTED) continue;
-
-            // check DL message
-            if (poll_dl_msg(ue->idx, &resp)) {
-                if (resp.msgid == MSG_RRC_UE_CONNECTION_RESPONSE) {
-                    if (ue->state == UE_IDLE && ue->s_tmsi == 0 &&
-                        resp.bitmask == BM_RANDOM_VALUE) {
-                        ue->s_tmsi = resp.s_tmsi & 0xFFFFFFFFFF;
-                        ue->state = UE_REGISTERED;
-  //      		pthread_mutex_lock(&shm->mutex);
-                        shm->ue_states[ue->idx] = UE_REGISTERED;
-    //    		pthread_mutex_unlock(&shm->mutex);
-                        ue->next_action_time = now + ue->x;
-                        printf("[UE %d] Registered (S-TMSI=0x%llx)\n",
-                               ue->idx, (unsigned long long)ue->s_tmsi);
-                    }
-                    else if (ue->state == UE_IDLE && resp.bitmask == BM_5G_STMSI) {
-                        ue->state = UE_CONNECTED;
-                        shm->ue_states[ue->idx] = UE_CONNECTED;
-                        printf("[UE %d] Connected after Paging Response\n", ue->idx);
-                    }
-                }
-                else if (resp.msgid == MSG_RRC_UE_PAGING) {
-                    if ((resp.s_tmsi & 0xFFFFFFFFFF) == ue->s_tmsi) {
-                        ue->uplink_ready = 1;
-                        // Trường hợp UE nhận Paging khi vẫn ở UE_REGISTERED do y < x 
-                        if (ue->state == UE_REGISTERED) {
-                            ue->state = UE_IDLE;
-                            shm->ue_states[ue->idx] = UE_IDLE; // chuyển state UE sang IDLE để gửi bản tin re-attach
-                            ue->next_action_time = 0;
-                            printf("[UE %d] Paging while REGISTERED -> force to IDLE\n", ue->idx);
-                        }
-                    }
-                }
-            }
 
-            // check timer Registered->Idle
-            if (ue->state == UE_REGISTERED &&
-                ue->next_action_time > 0 &&
-                now >= ue->next_action_time) {
-                ue->state = UE_IDLE
-                shm->ue_states[ue->idx] = UE_IDLE;
-                ue->uplink_ready = 0;
-                ue->next_action_time = 0;
-                printf("[UE %d] Timer expired -> back to IDLE\n", ue->idx);
+        // check DL message
+        int n;
+        while ((n = poll_dl_msgs(s, resp, RING_BURST)) > 0) {
+            for (int k = 0; k < n; k++) {
+                if (resp[k].ue_id - (uint32_t)s->first >= (uint32_t)s->n) continue;
+                int i = resp[k].ue_id;
+                trace_stamp(&resp[k].trace, HOP_UE_DEQ);
+                lat_record_hops(LAT_DL_SHM, &resp[k].trace, HOP_GNB_DL, HOP_UE_DEQ);
+                // UE CONNECTED chỉ còn nghe báo mất registration (AMF failover)
+                if (ue.state[i] == UE_CONNECTED &&
+                    !(resp[k].msgid == MSG_RRC_UE_REJECT && resp[k].cause == CAUSE_UE_UNKNOWN)) continue;
+                handle_dl_msg(s, i, &resp[k], now);
             }
         }
-        usleep(1000);
+
+        // check timer Registered->Idle: chỉ các UE đến hạn
+        s->now = now;
+        tw_advance(&s->x_wheel, now, on_x_timer, s);
+
+        // ngủ đến khi có bản tin DL hoặc đến timer gần nhất
+        doorbell_wait(&s->ring->dl_bell, seen, tw_next_timeout(&s->x_wheel, now));
     }
     return NULL;
 }
 
-int main() {
-    srand(time(NULL));
-    init_shm();
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-u num_ue] [-s seed] [-t traffic_spec] [-S shards] [-P]\n"
+                    "          [-n shm_name] [-o ue_offset]\n"
+                    "  traffic_spec: storm|poisson|ramp|diurnal[,rate=UE/s][,window=ms][,period=ms]\n"
+                    "                [,outage_at=ms,outage=ms][,churn=ms][,off=ms]\n"
+                    "  -P: run each shard as its own process instead of a thread pair\n"
+                    "  -o: global index of the first UE (disjoint TMSI ranges per gNB)\n", prog);
+    exit(1);
+}
+
+static void *xcalloc(size_t n, size_t size) {
+    void *p = calloc(n, size);
+    if (!p) { perror("calloc"); exit(1); }
+    return p;
+}
+
+// chạy uplink/downlink thread của các shard [from, to) và đợi chúng
+static void run_shards(int from, int to) {
+    pthread_t *tids = calloc(2 * (to - from), sizeof(pthread_t));
+    if (!tids) { perror("calloc"); exit(1); }
+    for (int k = from; k < to; k++) {
+        pthread_create(&tids[2 * (k - from)], NULL, uplink_thread, &shards[k]);
+        pthread_create(&tids[2 * (k - from) + 1], NULL, downlink_thread, &shards[k]);
+    }
+    for (int k = 0; k < 2 * (to - from); k++) pthread_join(tids[k], NULL);
+    free(tids);
+}
 
-    for (int i = 0; i < NUM_UE; i++) {
-        ue_list[i].idx = i;
-        ue_list[i].tmsi = 452040000000001ULL + i;
-        ue_list[i].s_tmsi = 0;
-        ue_list[i].x = rand_step500();
-        ue_list[i].state = UE_IDLE;
-        ue_list[i].uplink_ready = 1; // trigger attach lần đầu
+int main(int argc, char **argv) {
+    int ch, procs = 0;
+    unsigned int seed = (unsigned int)time(NULL);
+    const char *spec = DEFAULT_TRAFFIC;
+    const char *shm_name = SHM_NAME;
+    while ((ch = getopt(argc, argv, "u:s:t:S:Pn:o:")) != -1) {
+        switch (ch) {
+        case 'u': num_ue = atoi(optarg); break;
+        case 's': seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 't': spec = optarg; break;
+        case 'S': num_shards = atoi(optarg); break;
+        case 'P': procs = 1; break;
+        case 'n': shm_name = optarg; break;
+        case 'o': ue_offset = (uint32_t)strtoul(optarg, NULL, 0); break;
+        default: usage(argv[0]);
+        }
     }
+    if (num_ue <= 0 || tm_parse(spec, &traffic) < 0) usage(argv[0]);
+    if (num_shards <= 0 || num_shards > SHM_MAX_SHARDS) usage(argv[0]);
+    if (num_shards > num_ue) num_shards = num_ue;
 
-    pthread_t tid_ul, tid_dl;
-    pthread_create(&tid_ul, NULL, uplink_thread, NULL);
-    pthread_create(&tid_dl, NULL, downlink_thread, NULL);
+    shm = shm_create(shm_name, num_ue, num_shards);
+    ue.state = shm_states(shm);
+    ue.flags = xcalloc(num_ue, sizeof(uint8_t));
+    ue.s_tmsi = xcalloc(num_ue, sizeof(uint64_t));
+    ue.x = xcalloc(num_ue, sizeof(uint16_t));
+    ue.retries = xcalloc(num_ue, sizeof(uint8_t));
+    ue.rng = xcalloc(num_ue, sizeof(uint64_t));
+    ue.trace = xcalloc(num_ue, sizeof(Trace));
+    ue.x_timer = xcalloc(num_ue, sizeof(TimerNode));
+    ue.tm_timer = xcalloc(num_ue, sizeof(TimerNode));
+    shards = xcalloc(num_shards, sizeof(UeShard));
+    unsigned long long start = current_millis();
+    printf("UE: %d UEs in %d shard(s)%s, shm %s (%zu bytes), traffic %s, seed %u\n",
+           num_ue, num_shards, procs ? " as processes" : "", shm_name,
+           shm_size(num_ue, num_shards), spec, seed);
 
-    pthread_join(tid_ul, NULL);
-    pthread_join(tid_dl, NULL);
-    munmap(shm, SHM_SIZE);
+    for (int k = 0; k < num_shards; k++) {
+        UeShard *s = &shards[k];
+        s->idx = k;
+        s->ring = &shm->shard[k];
+        s->first = s->ring->first_ue;
+        s->n = s->ring->num_ue;
+        s->ready_words = (s->n + 63) / 64;
+        s->ready = xcalloc(s->ready_words ? s->ready_words : 1, sizeof(uint64_t));
+        s->outage_timer.id = -1;
+        tw_init(&s->x_wheel, start);
+        for (int i = s->first; i < s->first + s->n; i++) {
+            ue.state[i] = UE_IDLE;
+            ue.rng[i] = tm_seed(seed, ue_offset + i);
+            ue.x[i] = rand_step500(&ue.rng[i]);
+            ue.x_timer[i].id = i;
+            ue.tm_timer[i].id = i;
+            // attach lần đầu theo traffic model, delay 0 thì gửi ngay
+            int at = tm_arrival_ms(&traffic, num_ue, &ue.rng[i]);
+            if (at == 0) ue_set_ready(s, i);
+            else tm_schedule(s, i, 0, start + at);
+        }
+        if (traffic.outage_at_ms > 0) tw_add(&s->x_wheel, &s->outage_timer, start + traffic.outage_at_ms);
+    }
+
+    static char tag[64];
+    shm_tag(tag, sizeof(tag), "ue", shm_name);
+    if (!procs) {
+        lat_install_signals(tag);
+        log_init(tag);
+        run_shards(0, num_shards);
+        munmap(shm, shm_size(num_ue, num_shards));
+        return 0;
+    }
+
+    // -P: fork một process mỗi shard sau khi đã khởi tạo xong (mảng UE được copy-on-write),
+    // log/histogram riêng mỗi shard (ue<k>.binlog); parent chết thì shard nhận SIGTERM
+    fflush(stdout);
+    for (int k = 0; k < num_shards; k++) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork"); exit(1); }
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if (getppid() == 1) exit(0);
+            static char name[80];
+            snprintf(name, sizeof(name), "%s%d", tag, k);
+            lat_install_signals(name);
+            log_init(name);
+            run_shards(k, k + 1);
+            exit(0);
+        }
+    }
+    int status;
+    while (wait(&status) > 0) {}
     return 0;
 }
@@ -0,0 +1,259 @@
+#ifndef UE_TABLE_H
+#define UE_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sim_util.h"
+#include "timer_wheel.h"
+
+/*
+ * Kho UE context của AMF: mỗi UE một struct gọn, tra O(1) theo ue_id
+ * và theo S-TMSI bằng hai bảng băm open addressing (linear probing),
+ * tự nhân đôi khi đầy 70%. Context cấp phát theo chunk và không bao
+ * giờ bị di chuyển, nên con trỏ context (và TimerNode bên trong) ổn định.
+ * Context là toàn cục trong AMF (S-TMSI), còn (gnb, ue_id) là vị trí hiện
+ * tại của UE: UE attach lại hoặc service request qua gNB khác thì được
+ * bind sang gNB đó (ue_table_bind).
+ * Không thread-safe: mỗi bảng do một worker sở hữu.
+ *
+ * ue_table_open: chunk context nằm trong file mmap (MAP_SHARED) thay vì heap,
+ * nên context ghi tới đâu là ở trong page cache tới đó và sống qua lúc AMF
+ * chết. Khởi động lại thì map lại file, dựng lại hai chỉ mục trong RAM và
+ * xóa TimerNode (con trỏ của process cũ); caller arm lại timer paging.
+ * File: trang header rồi các chunk UE_CHUNK context liên tiếp, mỗi chunk
+ * một mmap riêng nên context không bao giờ bị di chuyển khi file lớn thêm.
+ */
+#define UE_CHUNK 1024
+#define UE_STORE_MAGIC   0x58544355u   // "UCTX"
+#define UE_STORE_VERSION 1
+#define UE_STORE_HDR     4096          // trang header, chunk bắt đầu từ offset này
+
+typedef struct {
+    uint64_t s_tmsi;
+    unsigned long long attach_time;    // thời gian attach (ms)
+    TimerNode paging_timer;            // attach_time + paging_delay
+    uint32_t ue_id;                    // id của UE trong gNB đang phục vụ
+    int paging_delay;                  // y (ms)
+    uint16_t gnb;                      // gNB đang phục vụ UE
+    uint8_t registered;
+} UeContext;
+
+#define ue_of_timer(t) ((UeContext *)((char *)(t) - offsetof(UeContext, paging_timer)))
+
+typedef struct {
+    uint64_t *keys;         // 0 = ô trống
+    UeContext **vals;
+    uint32_t cap;           // lũy thừa của 2
+    uint32_t count;
+} CtxIndex;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ctx_size;      // sizeof(UeContext) lúc ghi, khác thì bỏ file
+    _Atomic uint32_t count; // số context hợp lệ trong file
+} UeStoreHdr;
+
+typedef struct {
+    CtxIndex by_id;         // key = ue_key(gnb, ue_id)
+    CtxIndex by_stmsi;      // key = S-TMSI (khác 0)
+    UeContext **chunks;
+    uint32_t n_chunks;
+    uint32_t count;         // số context đã cấp
+    int store_fd;           // -1: context chỉ trong heap
+    UeStoreHdr *store;
+} UeTable;
+
+static inline uint64_t ue_key(uint16_t gnb, uint32_t ue_id) {
+    return ((uint64_t)gnb << 32 | ue_id) + 1;
+}
+
+static inline void *ctx_calloc(size_t n, size_t sz) {
+    void *p = calloc(n, sz);
+    if (!p) { perror("ue_table calloc"); exit(1); }
+    return p;
+}
+
+static inline void ctx_index_init(CtxIndex *ix, uint32_t cap) {
+    ix->cap = cap;
+    ix->count = 0;
+    ix->keys = ctx_calloc(cap, sizeof(uint64_t));
+    ix->vals = ctx_calloc(cap, sizeof(UeContext *));
+}
+
+static inline UeContext *ctx_index_find(const CtxIndex *ix, uint64_t key) {
+    uint32_t mask = ix->cap - 1;
+    for (uint32_t i = sim_hash64(key) & mask; ix->keys[i]; i = (i + 1) & mask)
+        if (ix->keys[i] == key) return ix->vals[i];
+    return NULL;
+}
+
+static inline void ctx_index_put(CtxIndex *ix, uint64_t key, UeContext *v);
+
+static inline void ctx_index_grow(CtxIndex *ix) {
+    CtxIndex old = *ix;
+    ctx_index_init(ix, old.cap * 2);
+    for (uint32_t i = 0; i < old.cap; i++)
+        if (old.keys[i]) ctx_index_put(ix, old.keys[i], old.vals[i]);
+    free(old.keys);
+    free(old.vals);
+}
+
+static inline void ctx_index_put(CtxIndex *ix, uint64_t key, UeContext *v) {
+    if ((ix->count + 1) * 10 > ix->cap * 7) ctx_index_grow(ix);
+    uint32_t mask = ix->cap - 1;
+    uint32_t i = sim_hash64(key) & mask;
+    while (ix->keys[i] && ix->keys[i] != key) i = (i + 1) & mask;
+    if (!ix->keys[i]) ix->count++;
+    ix->keys[i] = key;
+    ix->vals[i] = v;
+}
+
+// xóa bằng backward shift để chuỗi probe không bị đứt
+static inline void ctx_index_del(CtxIndex *ix, uint64_t key) {
+    uint32_t mask = ix->cap - 1;
+    uint32_t i = sim_hash64(key) & mask;
+    while (ix->keys[i] && ix->keys[i] != key) i = (i + 1) & mask;
+    if (!ix->keys[i]) return;
+    ix->count--;
+    for (uint32_t j = (i + 1) & mask; ix->keys[j]; j = (j + 1) & mask) {
+        uint32_t home = sim_hash64(ix->keys[j]) & mask;
+        // phần tử ở j có được phép dời về i không (home nằm ngoài khoảng (i, j])
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            ix->keys[i] = ix->keys[j];
+            ix->vals[i] = ix->vals[j];
+            i = j;
+        }
+    }
+    ix->keys[i] = 0;
+    ix->vals[i] = NULL;
+}
+
+static inline void ue_table_init(UeTable *t, uint32_t cap) {
+    uint32_t c = 16;
+    while (c < cap) c <<= 1;
+    ctx_index_init(&t->by_id, c);
+    ctx_index_init(&t->by_stmsi, c);
+    t->chunks = NULL;
+    t->n_chunks = 0;
+    t->count = 0;
+    t->store_fd = -1;
+    t->store = NULL;
+}
+
+#define UE_CHUNK_BYTES (UE_CHUNK * sizeof(UeContext))
+
+// thêm một chunk: heap, hoặc nới file rồi map phần mới
+static inline void ue_table_add_chunk(UeTable *t) {
+    t->chunks = realloc(t->chunks, (t->n_chunks + 1) * sizeof(UeContext *));
+    if (!t->chunks) { perror("ue_table realloc"); exit(1); }
+    UeContext *c;
+    if (t->store_fd < 0) {
+        c = ctx_calloc(UE_CHUNK, sizeof(UeContext));
+    } else {
+        off_t off = UE_STORE_HDR + (off_t)t->n_chunks * UE_CHUNK_BYTES;
+        struct stat st;
+        if (fstat(t->store_fd, &st) < 0) { perror("ue_table fstat"); exit(1); }
+        if (st.st_size < off + (off_t)UE_CHUNK_BYTES &&
+            ftruncate(t->store_fd, off + UE_CHUNK_BYTES) < 0) { perror("ue_table ftruncate"); exit(1); }
+        c = mmap(NULL, UE_CHUNK_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, t->store_fd, off);
+        if (c == MAP_FAILED) { perror("ue_table mmap"); exit(1); }
+    }
+    t->chunks[t->n_chunks++] = c;
+}
+
+static inline UeContext *ue_table_at(const UeTable *t, uint32_t k) {
+    return &t->chunks[k / UE_CHUNK][k % UE_CHUNK];
+}
+
+/*
+ * Gắn bảng (vừa ue_table_init, còn rỗng) với file context path: file hợp lệ
+ * thì nạp lại mọi context trong đó, không thì tạo file mới.
+ * Trả về số context nạp lại, -1 nếu không mở được file (bảng vẫn dùng heap).
+ */
+static inline int ue_table_open(UeTable *t, const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) { perror(path); return -1; }
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        (st.st_size < UE_STORE_HDR && ftruncate(fd, UE_STORE_HDR) < 0)) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    UeStoreHdr *h = mmap(NULL, UE_STORE_HDR, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED) { perror(path); close(fd); return -1; }
+    uint32_t n = atomic_load(&h->count);
+    off_t need = UE_STORE_HDR + (off_t)((n + UE_CHUNK - 1) / UE_CHUNK) * UE_CHUNK_BYTES;
+    if (h->magic != UE_STORE_MAGIC || h->version != UE_STORE_VERSION ||
+        h->ctx_size != sizeof(UeContext) || st.st_size < need) {
+        if (h->magic) fprintf(stderr, "%s: incompatible context file, starting empty\n", path);
+        if (ftruncate(fd, UE_STORE_HDR) < 0) perror(path);
+        h->version = UE_STORE_VERSION;
+        h->ctx_size = sizeof(UeContext);
+        atomic_store(&h->count, 0);
+        h->magic = UE_STORE_MAGIC;
+        n = 0;
+    }
+    t->store_fd = fd;
+    t->store = h;
+    while (t->n_chunks * UE_CHUNK < n) ue_table_add_chunk(t);
+    for (t->count = 0; t->count < n; t->count++) {
+        UeContext *c = ue_table_at(t, t->count);
+        memset(&c->paging_timer, 0, sizeof(c->paging_timer));   // con trỏ của process trước
+        ctx_index_put(&t->by_id, ue_key(c->gnb, c->ue_id), c);
+        if (c->s_tmsi) ctx_index_put(&t->by_stmsi, c->s_tmsi, c);
+    }
+    return (int)n;
+}
+
+static inline UeContext *ue_table_find_id(const UeTable *t, uint16_t gnb, uint32_t ue_id) {
+    return ctx_index_find(&t->by_id, ue_key(gnb, ue_id));
+}
+
+static inline UeContext *ue_table_find_stmsi(const UeTable *t, uint64_t s_tmsi) {
+    return s_tmsi ? ctx_index_find(&t->by_stmsi, s_tmsi) : NULL;
+}
+
+// trả về context của (gnb, ue_id), tạo mới (zero) nếu chưa có
+static inline UeContext *ue_table_get(UeTable *t, uint16_t gnb, uint32_t ue_id) {
+    UeContext *c = ue_table_find_id(t, gnb, ue_id);
+    if (c) return c;
+    if (t->count == t->n_chunks * UE_CHUNK) ue_table_add_chunk(t);
+    c = ue_table_at(t, t->count);
+    memset(c, 0, sizeof(*c));   // slot file có thể còn dữ liệu dở của lần chạy trước
+    t->count++;
+    c->ue_id = ue_id;
+    c->gnb = gnb;
+    if (t->store) atomic_store(&t->store->count, t->count);   // sau khi context có id
+    ctx_index_put(&t->by_id, ue_key(gnb, ue_id), c);
+    return c;
+}
+
+// chuyển context sang (gnb, ue_id) mới; trả về 1 nếu UE đổi vị trí
+static inline int ue_table_bind(UeTable *t, UeContext *c, uint16_t gnb, uint32_t ue_id) {
+    if (c->gnb == gnb && c->ue_id == ue_id) return 0;
+    ctx_index_del(&t->by_id, ue_key(c->gnb, c->ue_id));
+    c->gnb = gnb;
+    c->ue_id = ue_id;
+    ctx_index_put(&t->by_id, ue_key(gnb, ue_id), c);
+    return 1;
+}
+
+// gán S-TMSI cho context và cập nhật chỉ mục S-TMSI
+static inline void ue_table_set_stmsi(UeTable *t, UeContext *c, uint64_t s_tmsi) {
+    if (c->s_tmsi == s_tmsi) return;
+    if (c->s_tmsi) ctx_index_del(&t->by_stmsi, c->s_tmsi);
+    c->s_tmsi = s_tmsi;
+    if (s_tmsi) ctx_index_put(&t->by_stmsi, s_tmsi, c);
+}
+
+#endif